@@ -99,12 +99,13 @@ struct pcb_t
 {
 	uint32_t pid;		 // PID
 	uint32_t priority;	 // Default priority
-	char path[100];
+	char *path;		 // Program path, owned by the PCB
 	struct code_seg_t *code;
 	addr_t regs[10];
 	uint64_t pc;
 #ifdef MLQ_SCHED
 	uint32_t prio;
+	uint64_t dispatch_time;	 // Time slot of the last dispatch
 #endif
 
 #ifdef MM_PAGING
@@ -133,6 +134,9 @@ struct krnl_t
 	struct memphy_struct **mswp;
 	uint32_t active_mswp_id;
 	struct tlb_t *tlb;           /* <--- ADD TLB HERE */
+	struct zswap_pool *zswp;     /* compressed swap pool, NULL if disabled */
+	struct ksm_struct *ksm;      /* same-page merging, NULL if disabled */
+	addr_t zero_fpn;             /* shared zero frame, -1 if none */
 #endif
 };
 
@@ -14,6 +14,49 @@
 #define PAGING_MAX_PGN  (DIV_ROUND_UP(BIT(PAGING_CPU_BUS_WIDTH),PAGING_PAGESZ))
 
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
+#ifdef MM64
+/*
+ * 64-bit PTE: flags at the top, FPN or swap type/offset at the bottom.
+ * Bit 63 is left to the PMD leaf tag (PAGING64_PMD_HUGE_MASK).
+ *
+ *  62 present | 61 swapped | 60 referenced | 59 dirty | 58 huge
+ *  57..55 software | 54 readahead | 53 zero | 52 merged (KSM) | 51..40 usrnum | 39..0 FPN
+ *  swapped: 44..5 swap offset | 4..0 swap type
+ */
+#define PAGING_PTE_PRESENT_MASK BIT_ULL(62)
+#define PAGING_PTE_SWAPPED_MASK BIT_ULL(61)
+#define PAGING_PTE_REFERENCED_MASK BIT_ULL(60)
+#define PAGING_PTE_DIRTY_MASK BIT_ULL(59)
+#define PAGING_PTE_HUGE_MASK BIT_ULL(58) /* page of a 2MB mapping */
+#define PAGING_PTE_KSM_MASK BIT_ULL(52) /* shared merged frame, read-only */
+#define PAGING_PTE_ZERO_MASK BIT_ULL(53) /* demand-zero, no frame of its own */
+#define PAGING_PTE_RA_MASK BIT_ULL(54) /* read ahead from swap, not touched yet */
+
+/* SOFT - free for software use */
+#define PAGING_PTE_SOFT_LOBIT 55
+#define PAGING_PTE_SOFT_HIBIT 57
+/* USRNUM */
+#define PAGING_PTE_USRNUM_LOBIT 40
+#define PAGING_PTE_USRNUM_HIBIT 51
+/* FPN */
+#define PAGING_PTE_FPN_LOBIT 0
+#define PAGING_PTE_FPN_HIBIT 39
+/* SWPTYP */
+#define PAGING_PTE_SWPTYP_LOBIT 0
+#define PAGING_PTE_SWPTYP_HIBIT 4
+/* SWPOFF */
+#define PAGING_PTE_SWPOFF_LOBIT 5
+#define PAGING_PTE_SWPOFF_HIBIT 44
+
+/* PTE */
+#define PAGING_PTE_SOFT_MASK   GENMASK_ULL(PAGING_PTE_SOFT_HIBIT,PAGING_PTE_SOFT_LOBIT)
+#define PAGING_PTE_USRNUM_MASK GENMASK_ULL(PAGING_PTE_USRNUM_HIBIT,PAGING_PTE_USRNUM_LOBIT)
+#define PAGING_PTE_FPN_MASK    GENMASK_ULL(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
+#define PAGING_PTE_SWPTYP_MASK GENMASK_ULL(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
+#define PAGING_PTE_SWPOFF_MASK GENMASK_ULL(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+/* vmap_pgd_memset: tables built, no frame yet, present bit clear */
+#define PAGING_PTE_RESERVED    PAGING_PTE_FPN_MASK
+#else
 /* PTE BIT */
 #define PAGING_PTE_PRESENT_MASK BIT(31) 
 #define PAGING_PTE_SWAPPED_MASK BIT(30)
@@ -21,10 +64,9 @@
 #define PAGING_PTE_DIRTY_MASK BIT(28)
 #define PAGING_PTE_EMPTY01_MASK BIT(14)
 #define PAGING_PTE_EMPTY02_MASK BIT(13)
-
-/* PTE BIT PRESENT */
-#define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
-#define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK)
+#define PAGING_PTE_KSM_MASK PAGING_PTE_EMPTY01_MASK
+#define PAGING_PTE_ZERO_MASK PAGING_PTE_EMPTY02_MASK
+#define PAGING_PTE_RA_MASK 0 /* no readahead in 32 bit mode */
 
 /* USRNUM */
 #define PAGING_PTE_USRNUM_LOBIT 15
@@ -44,6 +86,11 @@
 #define PAGING_PTE_FPN_MASK    GENMASK(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
 #define PAGING_PTE_SWPTYP_MASK GENMASK(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
 #define PAGING_PTE_SWPOFF_MASK GENMASK(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+#endif
+
+/* PTE BIT PRESENT */
+#define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
+#define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK)
 
 /* Extract PTE */
 #define PAGING_PTE_OFFST(pte) GETVAL(pte,PAGING_OFFST_MASK,PAGING_ADDR_OFFST_LOBIT)
@@ -99,47 +146,51 @@
 #define INCLUDE(x1,x2,y1,y2) (0)
 #define OVERLAP(x1,x2,y1,y2) (0)
 
-/* Get present bit (bit 31) */
+/* Get present bit (bit 31, MM64: 62) */
 #define PAGING_PTE_GET_PRESENT(pte)   GETBIT((pte), PAGING_PTE_PRESENT_MASK) ? 1 : 0
 
-/* Get swapped bit (bit 30) */
+/* Get swapped bit (bit 30, MM64: 61) */
 #define PAGING_PTE_GET_SWAPPED(pte)   GETBIT((pte), PAGING_PTE_SWAPPED_MASK) ? 1 : 0
 
-/* Get dirty bit (bit 28) - nếu cần */
+/* Get dirty bit (bit 28, MM64: 59) - nếu cần */
 #define PAGING_PTE_GET_DIRTY(pte)     GETBIT((pte), PAGING_PTE_DIRTY_MASK) ? 1 : 0
 
-/* Get reserve bit (bit 29) - nếu cần */
+/* Get reserve bit (bit 29, MM64: 60) - nếu cần */
 #define PAGING_PTE_GET_REFERENCED(pte)   GETBIT((pte), PAGING_PTE_REFERENCED_MASK) ? 1 : 0
 
 /* Get swap type bits (bits 0-4) - chỉ khi swapped = 1 */
 #define PAGING_PTE_GET_SWPTYP(pte)    GETVAL((pte), PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT)
 
-/* Get swap offset bits (bits 5-25) - chỉ khi swapped = 1 */
+/* Get swap offset bits (bits 5-25, MM64: 5-44) - chỉ khi swapped = 1 */
 #define PAGING_PTE_GET_SWPOFF(pte)    GETVAL((pte), PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT)
 
-/* Get user-defined number bits (bits 15-27) - khi present = 1 */
+/* Get user-defined number bits (bits 15-27, MM64: 40-51) - khi present = 1 */
 #define PAGING_PTE_GET_USRNUM(pte)    GETVAL((pte), PAGING_PTE_USRNUM_MASK, PAGING_PTE_USRNUM_LOBIT)
 
-/* Get frame number bits (bits 0-12) - khi present = 1 */
+/* Get frame number bits (bits 0-12, MM64: 0-39) - khi present = 1 */
 #define PAGING_PTE_GET_FPN(pte)       GETVAL((pte), PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT)
 
 /* VM region prototypes */
 struct vm_rg_struct * init_vm_rg(addr_t rg_start, addr_t rg_end);
 int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct* rgnode);
-int enlist_pgn_node(struct pgn_t **pgnlist, addr_t pgn, struct pcb_t *caller);
+int enlist_pgn_node(struct mm_struct *mm, addr_t pgn, struct pcb_t *caller);
+void delist_pgn_node(struct mm_struct *mm, struct pgn_t *node);
+struct pgn_t *lookup_pgn_node(struct mm_struct *mm, struct pcb_t *owner, addr_t pgn);
+addr_t pgn_node_pte(struct pgn_t *node);
+void pgn_node_clear_bits(struct pgn_t *node, addr_t mask);
 int vmap_pgd_memset(struct pcb_t *caller, addr_t addr, int pgnum);
 addr_t vmap_page_range(struct pcb_t *caller, addr_t addr, int pgnum, 
-                    struct framephy_struct *frames, struct vm_rg_struct *ret_rg);
+                    addr_t *frames, struct vm_rg_struct *ret_rg);
 addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend, addr_t mapstart, int incpgnum, struct vm_rg_struct *ret_rg);
-addr_t alloc_pages_range(struct pcb_t *caller, int incpgnum, struct framephy_struct **frm_lst);
+addr_t alloc_pages_range(struct pcb_t *caller, int incpgnum, addr_t *frames);
 int __swap_cp_page(struct memphy_struct *mpsrc, addr_t srcfpn,
                 struct memphy_struct *mpdst, addr_t dstfpn, struct pcb_t *caller, int active_mswp_id);
 int get_pd_from_address(addr_t addr, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_t* pmd, addr_t* pt);
 int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_t* pmd, addr_t* pt);
 int pte_set_fpn(struct pcb_t *owner, addr_t pgn, addr_t fpn, int is_dirty);
 int pte_set_swap(struct pcb_t *owner, addr_t pgn, int swptyp, addr_t swpoff);
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn);
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val);
+addr_t pte_get_entry(struct pcb_t *caller, addr_t pgn);
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, addr_t pte_val);
 int init_pte(addr_t *pte,
              int pre,    // present
              addr_t fpn,    // FPN
@@ -152,6 +203,7 @@ int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+int free_mm(struct mm_struct *mm);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -172,15 +224,63 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, addr_t vmastart, a
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, addr_t size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz);
 int find_victim_page(struct mm_struct* mm, addr_t *pgn, struct pcb_t **ret_owner);
+int evict_victim_frame(struct pcb_t *caller, addr_t *retfpn);
+void swap_ra_print_stats(void);
+void swap_cache_drop(struct krnl_t *krnl, addr_t fpn);
+void swap_cache_print_stats(void);
+int reclaim_free_budget(struct krnl_t *krnl);
+int libkswapd_reclaim(struct krnl_t *krnl);
+void reclaim_print_stats(void);
+int libwriteback_scan(struct krnl_t *krnl);
+void writeback_print_stats(void);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *fpn);
+int MEMPHY_get_freefp_n(struct memphy_struct *mp, int nr, addr_t *fpns);
 int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn);
+struct frame_desc *MEMPHY_fdesc(struct memphy_struct *mp, addr_t fpn);
+void MEMPHY_set_fdesc(struct memphy_struct *mp, addr_t fpn, struct pcb_t *owner,
+                      addr_t pgn, int state);
+int MEMPHY_frame_hist(struct memphy_struct *mp, unsigned long *hist,
+                      unsigned long *nr_swpcache, unsigned long *nr_map);
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nr, int align, addr_t *fpn);
+int MEMPHY_put_freefp_range(struct memphy_struct *mp, addr_t fpn, int nr);
+int MEMPHY_put_freefp_batch(struct memphy_struct *mp, addr_t *fpns, int nr);
+int MEMPHY_nr_freefp(struct memphy_struct *mp);
+void MEMPHY_set_cpu(int cpu);
 int MEMPHY_read(struct memphy_struct * mp, addr_t addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, addr_t addr, BYTE data);
+int MEMPHY_read_page(struct memphy_struct *mp, addr_t fpn, BYTE *buf);
+int MEMPHY_write_page(struct memphy_struct *mp, addr_t fpn, const BYTE *buf);
+int MEMPHY_copy_page(struct memphy_struct *src, addr_t srcfpn,
+                     struct memphy_struct *dst, addr_t dstfpn);
 int MEMPHY_dump(struct memphy_struct * mp);
+int MEMPHY_dump_dirty(struct memphy_struct *mp);
+int MEMPHY_dump_range(struct memphy_struct *mp, addr_t fpn, addr_t nr);
 int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg);
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg, const char *path);
+int init_memphy_banks(struct memphy_struct *mp, struct memphy_bank *banks, int nr, int randomflg);
+int free_memphy(struct memphy_struct *mp);
+
+/* Compressed swap pool */
+struct zswap_pool *zswap_init(addr_t poolsz);
+int zswap_store(struct zswap_pool *zp, struct memphy_struct *mram, addr_t fpn, addr_t *handle);
+int zswap_load(struct zswap_pool *zp, struct memphy_struct *mram, addr_t handle, addr_t fpn);
+int zswap_invalidate(struct zswap_pool *zp, addr_t handle);
+void zswap_print_stats(struct zswap_pool *zp);
+void zswap_free(struct zswap_pool *zp);
+
+/* Same-page merging */
+struct ksm_struct *ksm_init(struct memphy_struct *mram);
+int ksm_scan_page(struct ksm_struct *ksm, struct pcb_t *owner, addr_t pgn);
+void ksm_drop_candidates(struct ksm_struct *ksm);
+int ksm_refs(struct ksm_struct *ksm, addr_t fpn);
+int ksm_put(struct ksm_struct *ksm, addr_t fpn);
+void ksm_note_alloc(struct ksm_struct *ksm, int nr);
+void ksm_print_stats(struct ksm_struct *ksm);
+void ksm_free(struct ksm_struct *ksm);
+int libksm_scan(struct krnl_t *krnl, int budget);
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
@@ -195,6 +295,8 @@ int print_pgtbl(struct pcb_t *ip, addr_t start, addr_t end);
 struct tlb_t* tlb_init();
 int tlb_insert(struct tlb_t* tlb, addr_t vpn, int fpn, uint32_t pid, 
                uint8_t dirty, uint8_t referenced);
+int tlb_insert_huge(struct tlb_t* tlb, addr_t vpn, int fpn, uint32_t pid,
+                    uint8_t dirty, uint8_t referenced);
 int tlb_lookup(struct tlb_t* tlb, addr_t vpn, uint32_t pid, int* fpn);
 int tlb_invalidate_entry(struct tlb_t* tlb, addr_t vpn, uint32_t pid);
 int tlb_invalidate_process(struct tlb_t* tlb, uint32_t pid);
@@ -10,6 +10,22 @@
 #define GENMASK64(h, l) \
 	(((~0ULL) << (l)) & (~0ULL >> (MM64_BITS_PER_LONG  - (h) - 1)))
 
+/* Page table node: 9 bits of index per level */
+#define PAGING64_PTRS_PER_TABLE 512
+#define PAGING64_TABLE_SZ (PAGING64_PTRS_PER_TABLE * sizeof(addr_t))
+#define PAGING64_LEVEL_BITS 9         /* index bits of one level */
+#define PAGING64_PGTBL_LEVELS 5
+#define PAGING64_TABLE_ALIGN 64       /* cache line */
+#define PAGING64_PGTBL_CHUNK_MAX 64   /* tables per arena chunk, 256KB */
+
+/* 2MB huge pages, mapped by a leaf entry at the PMD level */
+#define PAGING64_HUGE_NRPAGES PAGING64_PTRS_PER_TABLE
+#define PAGING64_HUGE_PAGESZ (PAGING64_HUGE_NRPAGES * PAGING64_PAGESZ)
+#define PAGING64_HUGE_PGN(pgn) ((pgn) >> PAGING64_LEVEL_BITS)
+/* table pointers never have bit 63 set, it tags a PMD entry as a leaf */
+#define PAGING64_PMD_HUGE_MASK BIT_ULL(63)
+#define PAGING64_PMD_IS_HUGE(pmde) (((pmde) & PAGING64_PMD_HUGE_MASK) != 0)
+
 #define PAGING64_MAX_PGN  (DIV_ROUND_UP(BIT_ULL(21),PAGING64_PAGESZ))
 #define PAGING64_PAGE_ALIGNSZ(sz) (DIV_ROUND_UP(sz,PAGING64_PAGESZ)*PAGING64_PAGESZ)
 
@@ -65,4 +81,24 @@
 
 
 
+/* Range based PTE operations, one walk per leaf table */
+typedef int (*pte_range_fn)(addr_t *pte, addr_t pgn, void *arg);
+int pte_for_each_range(struct mm_struct *mm, addr_t pgn, addr_t pgnum, int alloc,
+                       pte_range_fn fn, void *arg);
+int pte_map_range(struct pcb_t *owner, addr_t pgn, int pgnum,
+                  addr_t *frames, int is_dirty);
+int pte_map_huge(struct pcb_t *owner, addr_t pgn, addr_t fpn, int is_dirty);
+int pte_reserve_zero(struct pcb_t *owner, addr_t pgn, addr_t pgnum);
+int pte_map_zero(struct pcb_t *owner, addr_t pgn, addr_t zero_fpn);
+int zero_fill_frame(struct memphy_struct *mram, addr_t fpn);
+
+/* Page table arena */
+addr_t *pgtbl_alloc(struct mm_struct *mm);
+void pgtbl_release(struct mm_struct *mm);
+int pgtbl_teardown(struct mm_struct *mm, pte_range_fn fn, void *arg);
+void pgtbl_print_stats(void);
+void swap_print_stats(void);
+void dzero_print_stats(void);
+void pgwalk_cache_flush(struct mm_struct *mm);
+
 #endif
\ No newline at end of file
@@ -20,6 +20,30 @@
 //#define MMDBG 1
 #define IODUMP 1
 #define PAGETBL_DUMP 1
+#define MM_HUGEPAGE 1 /* 2MB pages for aligned heap growth, MM64 only */
+#define MM_SWAP_SEQ 1 /* swap devices are sequential, their seeks are modeled */
+#define MM_SWAP_NORESERVE 1 /* file-backed swap is mapped MAP_NORESERVE */
+//#define MM_SWAP_FILE_KEEP 1 /* leave swap backing files on the host at exit */
+#define MEMPHY_SEEK_FIXED_NS 100000 /* modeled cost of any cursor move */
+#define MEMPHY_SEEK_NS_PER_KB 10     /* plus this much per KB travelled */
+#define MM_ZSWAP 1 /* compress dirty victims into RAM before the swap devices */
+#define MM_ZSWAP_POOLSZ 0x100000 /* arena of the compressed pool */
+#define MM_FP_MAGAZINE 1 /* per-CPU free frame caches on large devices */
+#define MEMPHY_NUMA_REMOTE_NS 100 /* added to an access from another node */
+#define MM_KSM 1 /* merge identical frames from a background scanner */
+#define KSM_SCAN_BATCH 256 /* pages hashed per time slot */
+#define MM_DEMAND_ZERO 1 /* heap growth only reserves, pages fault in zero-filled */
+#define MM_SWAP_CLUSTER 16 /* swap slots a process takes from a device at once */
+#define MM_SWAP_RA 8 /* pages brought in by a swap-in fault, 1 disables readahead */
+#define MM_KSWAPD 1 /* background reclaim keeps free frames above the watermarks */
+#define KSWAPD_WMARK_MIN 2  /* percent of RAM frames, faults reclaim directly below */
+#define KSWAPD_WMARK_LOW 4  /* kswapd starts evicting below */
+#define KSWAPD_WMARK_HIGH 6 /* and stops at */
+#define KSWAPD_BATCH 32     /* evictions per time slot at most */
+#define MM_WRITEBACK 1 /* write dirty pages to swap ahead of the CLOCK hand */
+#define WB_START_PCT 12   /* percent of RAM frames free, writeback runs below */
+#define WB_SCAN_AHEAD 64  /* pages ahead of the hand looked at per time slot */
+#define WB_MAX_PAGES 8    /* pages written per time slot at most */
 
 /* 
  * @bksysnet:
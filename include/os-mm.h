@@ -12,13 +12,20 @@
 #define OSMM_H
 
 #include <stdint.h>
+#include <pthread.h>
 
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
+#define PAGING_ZSWP_ID PAGING_MAX_MMSWP /* swap type of the compressed pool */
+#define MEMPHY_NR_MAG 8     /* per-CPU frame magazines of a device */
+#define MEMPHY_MAG_SZ 64    /* frames a magazine holds */
+#define MEMPHY_MAG_BATCH 16 /* least frames moved per refill or drain */
+#define MEMPHY_MAX_NODES 8  /* RAM banks of a NUMA configuration */
 #define PAGING_MAX_SYMTBL_SZ 30
 
 /* TLB Configuration */
 #define TLB_SIZE 64        /* Số lượng entry trong TLB */
+#define TLB_HUGE_SIZE 8    /* Entry 2MB, fully associative */
 #define TLB_ENTRY_INVALID 0
 #define TLB_ENTRY_VALID   1
 
@@ -67,12 +74,24 @@ struct tlb_t {
     int misses;
     int size;
     uint64_t access_counter; /* Global counter for LRU timestamp */
+    struct tlb_entry_t huge[TLB_HUGE_SIZE]; /* vpn is the 2MB page number */
+    int huge_hits;
 };
 
+/*
+ * CLOCK list node, the list is circular and doubly linked. pte caches
+ * the leaf entry of the page (tables live as long as their mm), NULL
+ * for pages of a 2MB mapping.
+ */
 struct pgn_t{
    addr_t pgn;
    struct pcb_t *owner;
    struct pgn_t *pg_next; 
+   struct pgn_t *pg_prev;
+   struct pgn_t *pg_hnext; /* chain of the (owner, pgn) index */
+   struct pgn_t *pg_onext; /* pages of the same owner */
+   struct pgn_t *pg_oprev;
+   addr_t *pte;
 };
 
 /*
@@ -97,16 +116,60 @@ struct vm_area_struct {
    struct vm_area_struct *vm_next;
 };
 
+#ifdef MM64
+/*
+ * Page table arena - tables are carved out of aligned, pre-zeroed
+ * chunks and all of them are released together with the owning mm
+ */
+struct pgtbl_chunk {
+   addr_t *tables;          /* ntables consecutive 512-entry tables */
+   int ntables;
+   int used;
+   struct pgtbl_chunk *next;
+};
+
+struct pgtbl_arena {
+   struct pgtbl_chunk *chunks; /* head is the chunk being carved */
+   unsigned long nr_tables;    /* tables handed out */
+   unsigned long nr_chunks;
+   unsigned long bytes;        /* bytes reserved by the chunks */
+};
+
+/*
+ * Page walk cache - direct mapped on the PMD-level prefix (pgn >> 9),
+ * remembers the leaf table (or the 2MB PMD entry) so a hit skips the
+ * four upper levels
+ */
+#define PGWALK_CACHE_SZ 8
+
+struct pgwalk_cache {
+   addr_t tag[PGWALK_CACHE_SZ];
+   addr_t *pt[PGWALK_CACHE_SZ]; /* NULL marks an empty slot */
+   uint8_t huge[PGWALK_CACHE_SZ]; /* pt[] is the 2MB PMD entry itself */
+   unsigned long hits;
+   unsigned long misses;
+};
+#endif
+
 /* 
  * Memory management struct
+ *
+ * Lock order: mmvm_lock (libmem) -> pgtbl_lock -> tlb_lock or a
+ * memphy fp_lock. TLB and frame locks never nest, and no one takes
+ * a page table lock while holding them. Present PTEs are read
+ * without pgtbl_lock, so writers publish tables and entries with a
+ * single atomic store.
  */
 struct mm_struct {
 #ifdef MM64
+   pthread_mutex_t pgtbl_lock; /* the whole tree and the walk cache */
    addr_t *pgd;
    addr_t *p4d;
    addr_t *pud;
    addr_t *pmd;
    addr_t *pt;
+   struct pgtbl_arena pgtbl;
+   struct pgwalk_cache pwc;
 #else
    uint32_t *pgd;
 #endif
@@ -116,8 +179,19 @@ struct mm_struct {
    /* Currently we support a fixed number of symbol */
    struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
 
-   struct pgn_t *fifo_pgn;
+   struct pgn_t *fifo_pgn;    /* oldest page of the CLOCK list */
    struct pgn_t *clock_hand;
+   struct pgn_t *ksm_hand;    /* next page for ksmd, NULL between passes */
+   struct pgn_t **pgn_hash;   /* CLOCK nodes by (owner, pgn) */
+   int pgn_hash_sz;           /* power of 2, 0 until the first page */
+   int nr_pgn;
+   struct pgn_t *own_pgn;     /* this process's pages on the kernel CLOCK list */
+
+   /* Swap slots taken for this process and not used yet, evicted
+    * pages of one process land next to each other */
+   int swpc_id;
+   addr_t swpc_next;
+   int swpc_left;
 };
 
 /*
@@ -129,13 +203,175 @@ struct framephy_struct {
    struct mm_struct* owner;
 };
 
+/*
+ * Frame descriptor, one per frame of a device. A RAM frame names the
+ * page mapping it, a swap slot the page swapped to it, so both lead
+ * back to the PTE. Cleared when the frame goes back to the device.
+ */
+#define FRAME_FREE      0 /* free, or in use with no page yet */
+#define FRAME_ANON      1 /* private page of owner */
+#define FRAME_HUGE      2 /* one of the 512 frames of a 2MB page */
+#define FRAME_KSM       3 /* merged frame, ref pages map it */
+#define FRAME_ZERO      4 /* the shared zero frame, ref pages map it */
+#define FRAME_SWAP      5 /* slot holding a swapped page of owner */
+#define FRAME_SWAPCACHE 6 /* slot still holding a page now back in RAM */
+#define FRAME_NR_STATE  7
+
+struct frame_desc {
+   struct pcb_t *owner; /* NULL on shared frames */
+   addr_t pgn;
+   addr_t swp;          /* RAM only: swap slot holding the same page, 0 if none */
+   uint32_t ref;        /* pages mapping the frame */
+   uint8_t state;
+};
+
+/* One RAM bank of the configure file */
+struct memphy_bank {
+   addr_t size;
+   int cpu_first, cpu_last; /* CPUs local to the bank, none if first > last */
+   unsigned long access_ns; /* modeled cost of a local access */
+};
+
+/* Free frames cached by one CPU, only its allocator lock is taken on
+ * the fault path */
+struct fp_magazine {
+   pthread_mutex_t lock;
+   int nr;
+   addr_t fpn[MEMPHY_MAG_SZ];
+};
+
 struct memphy_struct {
    BYTE *storage;
-   int maxsz;
+   addr_t maxsz;
    int rdmflg;
-   int cursor;
-   struct framephy_struct *free_fp_list;
-   struct framephy_struct *used_fp_list;
+   addr_t cursor;
+   int backing_fd; /* host file mapped as storage, -1 when malloc'ed */
+   char *backing_path; /* its path, NULL when malloc'ed */
+
+   /* Seek model of a sequential device, in simulated ns */
+   unsigned long seek_fixed_ns;
+   unsigned long seek_ns_per_kb;
+   unsigned long nr_seeks;
+   unsigned long seek_bytes;
+   unsigned long seek_ns;
+   /* Free frames: a stack of frame numbers with the stack slot of
+    * each frame, and a bitmap with one bit set per allocated frame */
+   addr_t *fp_stack;
+   int *fp_pos;
+   uint64_t *fp_bitmap;
+   int fp_top;
+   int fp_cap;     /* slots in fp_stack and fp_pos */
+   int fp_hiwater; /* frames from here up were never handed out */
+   int nr_fp;
+   pthread_mutex_t fp_lock; /* frame allocator of this device */
+
+   /* Per-CPU magazines in front of the stack, NULL on small devices.
+    * A frame in a magazine keeps its fp_bitmap bit and has its
+    * mag_bitmap bit set. */
+   struct fp_magazine *mag;
+   uint64_t *mag_bitmap;
+   unsigned long mag_hit;    /* frames handed out from magazines */
+   unsigned long mag_refill;
+   unsigned long mag_drain;
+   unsigned long mag_flush;  /* all magazines emptied, the stack ran dry */
+
+   /* Frames written so far, and since the last incremental dump */
+   uint64_t *wr_bitmap;
+   uint64_t *dirty_bitmap;
+
+   /* Per frame state, NULL if it could not be allocated */
+   struct frame_desc *fdesc;
+
+   /* RAM split in NUMA nodes: each node is a device of its own over a
+    * slice of this storage with its own allocator, this device only
+    * dispatches. Frame numbers stay global, a node adds base_fpn. */
+   struct memphy_struct *node;
+   int nr_node;
+   addr_t base_fpn;
+   int cpu_first, cpu_last;
+   unsigned long access_ns;
+   unsigned long nr_local, nr_remote; /* accesses from CPUs on / off the node */
+   unsigned long nr_fallback;         /* frames given to a remote CPU */
+   unsigned long numa_ns;             /* modeled access time */
 };
+
+/*
+ * Compressed swap pool, dirty victims land here before any swap device.
+ * A swapped PTE of type PAGING_ZSWP_ID holds an entry index as offset.
+ */
+#define ZSWP_FREE 0
+#define ZSWP_SAME 1 /* every word of the page is fill */
+#define ZSWP_ZRL  2 /* zero-run encoded in the arena */
+
+struct zswap_entry {
+   uint8_t kind;
+   uint16_t len;   /* encoded bytes */
+   uint32_t chunk; /* first arena chunk */
+   uint64_t fill;
+};
+
+struct zswap_pool {
+   BYTE *arena;
+   uint64_t *chunk_map; /* one bit set per chunk in use */
+   uint32_t nr_chunks;
+   uint32_t chunk_hint; /* next first-fit scan starts here */
+   uint32_t used_chunks;
+   uint32_t peak_chunks;
+
+   struct zswap_entry *ent;
+   uint32_t *ent_free; /* stack of released entry indexes */
+   uint32_t nr_ent;    /* entries ever handed out */
+   uint32_t cap_ent;
+   uint32_t nr_ent_free;
+
+   unsigned long nr_same;
+   unsigned long nr_zrl;
+   unsigned long nr_reject; /* did not shrink enough */
+   unsigned long nr_full;   /* no room left in the arena */
+   unsigned long nr_load;
+   unsigned long nr_drop;   /* released without a load, the owner exited */
+   unsigned long bytes_in;
+   unsigned long bytes_out;
+   pthread_mutex_t lock;
+};
+
+/*
+ * Same-page merging. Identical anonymous frames are folded into one
+ * shared frame mapped read-only (PAGING_PTE_KSM_MASK) by every PTE,
+ * a write gives the writer its own copy back. Every field is guarded
+ * by the mmvm lock of libmem.c.
+ */
+#define KSM_HASH_SZ 4096
+
+struct ksm_item {
+   uint64_t hash;
+   addr_t fpn;           /* mappings and owner live in its frame_desc */
+   struct ksm_item *next;
+};
+
+struct ksm_frame {
+   struct ksm_item *stable; /* set while the frame is shared */
+   uint32_t csum;           /* content seen by the previous pass */
+};
+
+struct ksm_struct {
+   struct memphy_struct *mram;
+   struct ksm_frame *frame;                 /* one per RAM frame */
+   struct ksm_item *stable[KSM_HASH_SZ];
+   struct ksm_item *unstable[KSM_HASH_SZ];  /* emptied after each pass */
+   int pass_pages;                          /* looked at in the current pass */
+
+   unsigned long nr_scanned;
+   unsigned long nr_pass;
+   unsigned long nr_volatile; /* changed since the previous pass */
+   unsigned long nr_merged;
+   unsigned long nr_shared;   /* stable frames now */
+   unsigned long nr_saved;    /* frames freed by merging, now */
+   unsigned long peak_saved;
+   unsigned long nr_cow;      /* writes that took a private copy */
+   unsigned long nr_unshared; /* writes to the last mapping, kept the frame */
+   unsigned long nr_avoided;  /* allocations only possible thanks to merging */
+};
+
 void tlb_dump(struct tlb_t *tlb);
 #endif
\ No newline at end of file
@@ -4,11 +4,15 @@
 
 #include "common.h"
 
-#define MAX_QUEUE_SIZE 50
+/* Initial capacity of a queue, it grows on demand */
+#define QUEUE_INIT_SIZE 64
 
+/* Ring buffer of PCB pointers, the zero value is an empty queue */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t ** proc;
+	int head;
 	int size;
+	int capacity;
 };
 
 void enqueue(struct queue_t * q, struct pcb_t * proc);
@@ -17,6 +21,9 @@ struct pcb_t * dequeue(struct queue_t * q);
 
 struct pcb_t *purgequeue(struct queue_t *q, struct pcb_t *proc);
 
+/* Get the [idx]-th process from the head of queue [q] */
+struct pcb_t * queue_at(struct queue_t * q, int idx);
+
 int empty(struct queue_t * q);
 
 #endif
@@ -21,9 +21,41 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <time.h>
 
 static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Swap-in faults and what readahead did for them, under mmvm_lock */
+static unsigned long swpra_faults = 0;
+static unsigned long swpra_pages = 0;
+static unsigned long swpra_hits = 0;
+static unsigned long swpra_wasted = 0;
+static unsigned long swpc_clusters = 0;
+static int swpc_backoff[PAGING_MAX_MMSWP]; /* single slots before retrying a cluster */
+
+/* Swap cache, under mmvm_lock */
+static unsigned long swpcache_adds = 0;
+static unsigned long swpcache_drops = 0;
+static unsigned long swpcache_hits = 0;
+
+/* Page reclaim, direct (in the faulting process) against kswapd */
+static unsigned long reclaim_direct = 0;
+static unsigned long reclaim_direct_ns = 0;
+static unsigned long reclaim_direct_max_ns = 0;
+static unsigned long reclaim_bg = 0;
+static unsigned long reclaim_bg_ns = 0;
+static unsigned long kswapd_wakeups = 0;
+static unsigned long kswapd_slots = 0;
+static unsigned long reclaim_dirty = 0; /* victims written out when evicted */
+static unsigned long reclaim_clean = 0;
+
+/* Dirty page writeback ahead of the CLOCK hand, under mmvm_lock */
+static unsigned long wb_slots = 0;
+static unsigned long wb_active = 0;
+static unsigned long wb_scanned = 0;
+static unsigned long wb_written = 0;
+static unsigned long wb_throttled = 0;
+
 /*enlist_vm_freerg_list - add new rg to freerg_list
  *@mm: memory region
  *@rg_elmt: new region
@@ -267,6 +299,384 @@ printf("%s:%d\n",__func__,__LINE__);
   return 0;//val;
 }
 
+/*swap_cache_add - remember that slot of swp_id still holds frame fpn
+ *@krnl: kernel
+ *@fpn: RAM frame, clean
+ *@swp_id: swap device
+ *@slot: slot on it
+ *
+ * Return: 0, or -1 when the frame has no descriptor to keep the slot
+ *         in: the slot is released and the page must stay dirty
+ */
+static int swap_cache_add(struct krnl_t *krnl, addr_t fpn, int swp_id, addr_t slot)
+{
+    struct frame_desc *fd = MEMPHY_fdesc(krnl->mram, fpn);
+    struct frame_desc *sd = MEMPHY_fdesc(krnl->mswp[swp_id], slot);
+    addr_t ent = 0;
+
+    if (fd == NULL) {
+        MEMPHY_put_freefp(krnl->mswp[swp_id], slot);
+        return -1;
+    }
+    /* Kept in the form of a swapped PTE, 0 means no slot */
+    SETBIT(ent, PAGING_PTE_SWAPPED_MASK);
+    SETVAL(ent, swp_id, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
+    SETVAL(ent, slot, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
+    fd->swp = ent;
+    if (sd != NULL)
+        sd->state = FRAME_SWAPCACHE;
+    return 0;
+}
+
+/*swap_cache_drop - the content of frame fpn changes or goes away, its
+ *                  swap slot is not a copy anymore and is released
+ *@krnl: kernel
+ *@fpn: RAM frame
+ */
+void swap_cache_drop(struct krnl_t *krnl, addr_t fpn)
+{
+    struct frame_desc *fd = MEMPHY_fdesc(krnl->mram, fpn);
+
+    if (fd == NULL || fd->swp == 0)
+        return;
+    MEMPHY_put_freefp(krnl->mswp[PAGING_PTE_GET_SWPTYP(fd->swp)], PAGING_SWP(fd->swp));
+    fd->swp = 0;
+    swpcache_drops++;
+}
+
+/*swap_in_frame - copy the swapped page of pte into RAM frame fpn
+ *@caller: faulting process
+ *@pte: swapped PTE
+ *@fpn: target frame
+ *
+ * A device slot stays in the swap cache and the page comes in clean. A
+ * zswap entry is released on load, RAM holds the only copy and the page
+ * is dirty.
+ * Return: the dirty bit for the new PTE
+ */
+static int swap_in_frame(struct pcb_t *caller, addr_t pte, addr_t fpn)
+{
+    addr_t swpfpn = PAGING_SWP(pte);
+    int swp_id = PAGING_PTE_GET_SWPTYP(pte);
+    struct sc_regs regs;
+
+    printf("SWAP IN: SWAP %d(%lu) -> RAM(%lu)\n", swp_id, swpfpn, fpn);
+    if (swp_id == PAGING_ZSWP_ID) {
+        zswap_load(caller->krnl->zswp, caller->krnl->mram, swpfpn, fpn);
+        printf("Loaded zswap entry %lu\n", swpfpn);
+        return 1;
+    }
+
+    regs.a1 = SYSMEM_SWP_OP;
+    regs.a2 = swpfpn;
+    regs.a3 = fpn;
+    regs.a4 = 1;          // Direction IN
+    regs.a5 = swp_id;
+    syscall(caller->krnl, caller->pid, 17, &regs);
+    if (swap_cache_add(caller->krnl, fpn, swp_id, swpfpn) != 0)
+        return 1; /* RAM holds the only copy */
+    swpcache_adds++;
+
+    return 0;
+}
+
+/* A page stops mapping the zero frame */
+static void zero_frame_unmap(struct memphy_struct *mram, addr_t pte)
+{
+    struct frame_desc *zd = MEMPHY_fdesc(mram, PAGING_FPN(pte));
+
+    if (zd != NULL && zd->state == FRAME_ZERO && zd->ref > 0)
+        zd->ref--;
+}
+
+/*swap_slot_get - swap slot for an evicted page of mm
+ *@krnl: kernel
+ *@mm: owner of the page
+ *@swp_id: device of the slot
+ *@swpfpn: the slot
+ *
+ * Slots come from the cluster of mm, a new cluster is cut from the next
+ * device in round robin order. A device too fragmented for a cluster
+ * hands out single slots for a while.
+ */
+static int swap_slot_get(struct krnl_t *krnl, struct mm_struct *mm, int *swp_id, addr_t *swpfpn)
+{
+    int i;
+
+    if (mm->swpc_left > 0 && krnl->mswp[mm->swpc_id] != NULL) {
+        *swp_id = mm->swpc_id;
+        *swpfpn = mm->swpc_next++;
+        mm->swpc_left--;
+        return 0;
+    }
+
+    for (i = 0; i < PAGING_MAX_MMSWP; i++) {
+        int id = (krnl->active_mswp_id + i) % PAGING_MAX_MMSWP;
+        struct memphy_struct *swp = krnl->mswp[id];
+
+        if (swp == NULL)
+            continue;
+        if (MM_SWAP_CLUSTER > 1 && swpc_backoff[id] == 0 &&
+            MEMPHY_get_freefp_range(swp, MM_SWAP_CLUSTER, 1, swpfpn) == 0) {
+            mm->swpc_id = id;
+            mm->swpc_next = *swpfpn + 1;
+            mm->swpc_left = MM_SWAP_CLUSTER - 1;
+            swpc_clusters++;
+        } else {
+            if (swpc_backoff[id] > 0)
+                swpc_backoff[id]--;
+            else
+                swpc_backoff[id] = MM_SWAP_CLUSTER * 4;
+            if (MEMPHY_get_freefp(swp, swpfpn) != 0)
+                continue;
+        }
+        *swp_id = id;
+        krnl->active_mswp_id = (id + 1) % PAGING_MAX_MMSWP;
+        return 0;
+    }
+
+    return -1;
+}
+
+static unsigned long reclaim_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/*reclaim_wmark - free frame watermarks of RAM
+ *@mram: RAM
+ *@pct: KSWAPD_WMARK_MIN, _LOW or _HIGH
+ *@floor: lowest value, keeps min < low < high on a small RAM
+ */
+static int reclaim_wmark(struct memphy_struct *mram, int pct, int floor)
+{
+    int wmark = (int)(mram->maxsz / PAGING64_PAGESZ * pct / 100);
+
+    return (wmark > floor) ? wmark : floor;
+}
+
+#ifdef MM_KSWAPD
+#define WMARK_MIN(mram)  reclaim_wmark(mram, KSWAPD_WMARK_MIN, 1)
+#define WMARK_LOW(mram)  reclaim_wmark(mram, KSWAPD_WMARK_LOW, 2)
+#define WMARK_HIGH(mram) reclaim_wmark(mram, KSWAPD_WMARK_HIGH, 3)
+#else
+#define WMARK_MIN(mram)  0
+#define WMARK_LOW(mram)  0
+#define WMARK_HIGH(mram) 0
+#endif
+
+/*reclaim_free_budget - free frames a fault may take, those above the
+ *min watermark. The rest is left to kswapd and to the next direct reclaim.
+ */
+int reclaim_free_budget(struct krnl_t *krnl)
+{
+    int budget = MEMPHY_nr_freefp(krnl->mram) - WMARK_MIN(krnl->mram);
+
+    return (budget > 0) ? budget : 0;
+}
+
+/*ram_get_freefp - a free RAM frame for a fault, -1 at the min watermark */
+static int ram_get_freefp(struct krnl_t *krnl, addr_t *fpn)
+{
+#ifdef MM_KSWAPD
+    if (reclaim_free_budget(krnl) == 0)
+        return -1;
+#endif
+    return MEMPHY_get_freefp(krnl->mram, fpn);
+}
+
+/*__evict_victim - free a RAM frame by evicting a CLOCK victim
+ *@krnl: kernel
+ *@caller: process that needs the frame, NULL for kswapd
+ *@retfpn: the frame of the victim, now owned by the caller
+ *
+ * A dirty victim goes to the compressed pool or to a slot of the swap
+ * cluster of its owner. A clean one goes back to the slot the swap cache
+ * kept for it without a write. A clean page without such a slot is
+ * written like a dirty one, its PTE is never simply cleared.
+ */
+static int __evict_victim(struct krnl_t *krnl, struct pcb_t *caller, addr_t *retfpn)
+{
+    addr_t vicpgn, vicfpn, swpfpn;
+    addr_t vicpte;
+    struct pcb_t *vic_owner;
+    struct sc_regs regs;
+
+    if (find_victim_page(krnl->mm, &vicpgn, &vic_owner) == -1) {
+        printf("ERROR: Cannot find victim page\n");
+        return -1;
+    }
+
+    vicpte = pte_get_entry(vic_owner, vicpgn);
+    vicfpn = PAGING_FPN(vicpte);
+    int vic_is_dirty = PAGING_PTE_GET_DIRTY(vicpte);
+
+    struct frame_desc *fd = MEMPHY_fdesc(krnl->mram, vicfpn);
+    addr_t cached = fd ? fd->swp : 0;
+
+    /* Without a cached slot RAM holds the only copy, clean or not */
+    if (cached == 0)
+        vic_is_dirty = 1;
+
+    printf("Selected VICTIM: PID=%d, pgn=%lu, fpn=%lu, pte=0x%016lx, dirty=%d\n",
+            vic_owner->pid, vicpgn, vicfpn, vicpte, vic_is_dirty);
+    if (vicpte & PAGING_PTE_RA_MASK)
+        swpra_wasted++;
+
+    if (vic_is_dirty)
+        reclaim_dirty++;
+    else
+        reclaim_clean++;
+
+    // CHỈ SWAP OUT NẾU VICTIM LÀ DIRTY
+    if (vic_is_dirty) {
+        swap_cache_drop(krnl, vicfpn);
+        /* Pool nén trước, rồi mới tới các thiết bị SWAP */
+        int found_swp_id = -1;
+        if (zswap_store(krnl->zswp, krnl->mram, vicfpn, &swpfpn) == 0)
+            found_swp_id = PAGING_ZSWP_ID;
+        else if (swap_slot_get(krnl, vic_owner->mm, &found_swp_id, &swpfpn) != 0)
+            found_swp_id = -1;
+
+        if (found_swp_id == -1) {
+            printf("ERROR: ALL SWAP DEVICES ARE FULL!\n");
+            return -1;
+        }
+        printf("Free SWAP frame obtained at SWAP %d: swpfpn=%lu\n", found_swp_id, swpfpn);
+
+        // Swap Out: RAM -> SWAP được chọn
+        printf("SWAP OUT: RAM(%lu) -> SWAP %d(%lu) because dirty=1\n",
+               vicfpn, found_swp_id, swpfpn);
+        if (found_swp_id != PAGING_ZSWP_ID && caller == NULL) {
+            /* kswapd is kernel code, no process to make the syscall */
+            __mm_swap_page(vic_owner, vicfpn, swpfpn, 0, found_swp_id);
+        } else if (found_swp_id != PAGING_ZSWP_ID) {
+            regs.a1 = SYSMEM_SWP_OP;
+            regs.a2 = vicfpn;
+            regs.a3 = swpfpn;
+            regs.a4 = 0;            // Direction OUT
+            regs.a5 = found_swp_id;
+            syscall(krnl, caller->pid, 17, &regs);
+        }
+
+        // Update victim PTE với đúng ID vùng swap
+        pte_set_swap(vic_owner, vicpgn, found_swp_id, swpfpn);
+
+        // TLB COHERENCE: Invalidate victim TLB entry
+        if (vic_owner->krnl->tlb) {
+            tlb_invalidate_entry(vic_owner->krnl->tlb, vicpgn, vic_owner->pid);
+            printf("  Invalidated TLB entry for swapped out victim: VPN %lu (PID=%d)\n",
+                   vicpgn, vic_owner->pid);
+        }
+
+        printf("Updated VICTIM PTE (PID=%d, pgn=%lu) to point to SWAP %d(%lu)\n",
+                vic_owner->pid, vicpgn, found_swp_id, swpfpn);
+    } else {
+        /* The slot still holds the page, the PTE takes it back */
+        fd->swp = 0;
+        pte_set_swap(vic_owner, vicpgn, PAGING_PTE_GET_SWPTYP(cached), PAGING_SWP(cached));
+        swpcache_hits++;
+        printf("VICTIM is CLEAN, back to its cached SWAP %d(%lu) without a write\n",
+               (int)PAGING_PTE_GET_SWPTYP(cached), (addr_t)PAGING_SWP(cached));
+    }
+
+    *retfpn = vicfpn;
+    return 0;
+}
+
+/*evict_victim_frame - direct reclaim, the faulting process evicts a
+ *CLOCK victim itself and takes its frame
+ *@caller: process that needs the frame
+ *@retfpn: the frame of the victim, now owned by the caller
+ */
+int evict_victim_frame(struct pcb_t *caller, addr_t *retfpn)
+{
+    unsigned long t0 = reclaim_now_ns(), dt;
+    int ret = __evict_victim(caller->krnl, caller, retfpn);
+
+    if (ret == 0) {
+        dt = reclaim_now_ns() - t0;
+        reclaim_direct++;
+        reclaim_direct_ns += dt;
+        if (dt > reclaim_direct_max_ns)
+            reclaim_direct_max_ns = dt;
+    }
+    return ret;
+}
+
+/*swap_readahead - bring in the swapped pages that follow pgn
+ *@caller: faulting process
+ *@pgn: page just swapped in
+ *
+ * Only pages of the same VMA, and only into the free frames above the
+ * low watermark: readahead never evicts nor wakes kswapd. The pages are
+ * not referenced, CLOCK takes them first if nobody touches them.
+ */
+static int swap_readahead(struct pcb_t *caller, int pgn)
+{
+    struct vm_area_struct *vma;
+    addr_t addr = (addr_t)pgn * PAGING64_PAGESZ;
+    int k, nr = 0;
+    int room = MEMPHY_nr_freefp(caller->krnl->mram) - WMARK_LOW(caller->krnl->mram);
+
+    for (vma = caller->mm->mmap; vma != NULL; vma = vma->vm_next)
+        if (addr >= vma->vm_start && addr < vma->vm_end)
+            break;
+    if (vma == NULL)
+        return 0;
+
+    for (k = 1; k < MM_SWAP_RA; k++) {
+        addr_t rapgn = pgn + k;
+        addr_t pte, fpn;
+        int dirty;
+
+        if ((rapgn + 1) * PAGING64_PAGESZ > vma->vm_end)
+            break;
+        pte = pte_get_entry(caller, rapgn);
+        if (!(pte & PAGING_PTE_SWAPPED_MASK))
+            continue;
+        if (nr >= room || MEMPHY_get_freefp(caller->krnl->mram, &fpn) != 0)
+            break;
+
+        printf("READAHEAD: pgn=%lu\n", rapgn);
+        dirty = swap_in_frame(caller, pte, fpn);
+        pte_set_fpn(caller, rapgn, fpn, dirty);
+        pte = pte_get_entry(caller, rapgn);
+        SETBIT(pte, PAGING_PTE_RA_MASK);
+        CLRBIT(pte, PAGING_PTE_REFERENCED_MASK);
+        pte_set_entry(caller, rapgn, pte);
+        enlist_pgn_node(caller->krnl->mm, rapgn, caller);
+        nr++;
+    }
+    swpra_pages += nr;
+
+    return nr;
+}
+
+/*swap_ra_print_stats - report swap-in faults and readahead */
+void swap_ra_print_stats(void)
+{
+    printf("===== SWAP READAHEAD =====\n");
+    printf("Swap-in faults: %lu\n", swpra_faults);
+    printf("Read ahead: %lu pages, %lu used, %lu evicted untouched\n",
+           swpra_pages, swpra_hits, swpra_wasted);
+    printf("Slot clusters: %lu of %d slots\n", swpc_clusters, MM_SWAP_CLUSTER);
+    printf("==========================\n");
+}
+
+/*swap_cache_print_stats - report the swap writes the swap cache saved */
+void swap_cache_print_stats(void)
+{
+    printf("===== SWAP CACHE =====\n");
+    printf("Swap-ins that kept their slot: %lu\n", swpcache_adds);
+    printf("Swap writes avoided: %lu clean victims went back to their slot\n", swpcache_hits);
+    printf("Slots released on a write or a merge: %lu\n", swpcache_drops);
+    printf("======================\n");
+}
+
 /*pg_getpage - get the page in ram
  *@mm: memory region
  *@pagenum: PGN
@@ -275,10 +685,10 @@ printf("%s:%d\n",__func__,__LINE__);
  */
 int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
 {
-    uint32_t old_pte = pte_get_entry(caller, pgn);
+    addr_t old_pte = pte_get_entry(caller, pgn); /* 0 without a leaf table */
     
     printf("=== pg_getpage DEBUG ===\n");
-    printf("PID: %d, Request page: pgn=%d, old_pte=0x%08x\n",
+    printf("PID: %d, Request page: pgn=%d, old_pte=0x%016lx\n",
             caller->pid, pgn, old_pte);
     printf("Page Present? %s\n",
             PAGING_PAGE_PRESENT(old_pte) ? "YES" : "NO");
@@ -287,12 +697,14 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
     printf("Page Dirty? %s\n",
             (old_pte & PAGING_PTE_DIRTY_MASK) ? "YES" : "NO");
 
-    if (!PAGING_PAGE_PRESENT(old_pte))
+    /* A page on the zero frame faults like an absent one */
+    if (!PAGING_PAGE_PRESENT(old_pte) || (old_pte & PAGING_PTE_ZERO_MASK))
     {
         printf(">>> PAGE FAULT TRIGGERED! <<<\n");
         addr_t tgtfpn;
-        struct sc_regs regs;
-        int is_swapped = (old_pte & PAGING_PTE_SWAPPED_MASK);
+        if (PAGING_PAGE_PRESENT(old_pte))
+            zero_frame_unmap(caller->krnl->mram, old_pte);
+        int is_swapped = (old_pte & PAGING_PTE_SWAPPED_MASK) ? 1 : 0;
         addr_t old_swpfpn = 0;
         int old_swp_id = 0;
 
@@ -305,27 +717,15 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
         }
         
         // --- 1. CỐ GẮNG LẤY FRAME TRỐNG TRONG RAM ---
-        if (MEMPHY_get_freefp(caller->krnl->mram, &tgtfpn) == 0) 
+        if (ram_get_freefp(caller->krnl, &tgtfpn) == 0) 
         {
             printf("RAM has free frame: fpn=%lu\n", tgtfpn);
+            ksm_note_alloc(caller->krnl->ksm, 1);
             
             if (is_swapped) 
             {
-                printf("SWAP IN: SWAP %d(%lu) -> RAM(%lu)\n",
-                        old_swp_id, old_swpfpn, tgtfpn);
-                
-                regs.a1 = SYSMEM_SWP_OP;
-                regs.a2 = old_swpfpn;
-                regs.a3 = tgtfpn;
-                regs.a4 = 1;          // Direction IN
-                regs.a5 = old_swp_id;
-                syscall(caller->krnl, caller->pid, 17, &regs);
-                
-                MEMPHY_put_freefp(caller->krnl->mswp[old_swp_id], old_swpfpn);
-                printf("Freed swap frame %lu back to SWAP %d\n", old_swpfpn, old_swp_id);
-                
-                // SWAP IN: dirty = 0
-                pte_set_fpn(caller, pgn, tgtfpn, 0);
+                int dirty = swap_in_frame(caller, old_pte, tgtfpn);
+                pte_set_fpn(caller, pgn, tgtfpn, dirty);
                 
                 // TLB COHERENCE: Invalidate stale entry
                 if (caller->krnl->tlb) {
@@ -334,12 +734,13 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
                            pgn, caller->pid);
                 }
                 
-                printf("Updated PTE for pgn=%d -> fpn=%lu (dirty=0, swap in)\n", pgn, tgtfpn);
+                printf("Updated PTE for pgn=%d -> fpn=%lu (dirty=%d, swap in)\n", pgn, tgtfpn, dirty);
             } 
             else 
             {
                 printf("First allocation in RAM at fpn=%lu\n", tgtfpn);
-                // TẠO MỚI: dirty = 1
+                // TẠO MỚI: dirty = 1, the frame may hold an old page
+                zero_fill_frame(caller->krnl->mram, tgtfpn);
                 pte_set_fpn(caller, pgn, tgtfpn, 1);
                 
                 // TLB COHERENCE: Invalidate any existing entry
@@ -356,101 +757,14 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
         {
             // --- 2. RAM FULL - THAY THẾ TRANG (CLOCK Algorithm) ---
             printf("RAM FULL! Need to find VICTIM for SWAP OUT\n");
-            
-            addr_t vicpgn, vicfpn, swpfpn;
-            uint32_t vicpte;
-            struct pcb_t *vic_owner;
-
-            if (find_victim_page(caller->krnl->mm, &vicpgn, &vic_owner) == -1) {
-                printf("ERROR: Cannot find victim page\n");
+            if (evict_victim_frame(caller, &tgtfpn) != 0)
                 return -1;
-            }
-
-            vicpte = pte_get_entry(vic_owner, vicpgn);
-            vicfpn = PAGING_FPN(vicpte);
-            int vic_is_dirty = PAGING_PTE_GET_DIRTY(vicpte);
-            
-            printf("Selected VICTIM: PID=%d, pgn=%lu, fpn=%lu, pte=0x%08x, dirty=%d\n",
-                    vic_owner->pid, vicpgn, vicfpn, vicpte, vic_is_dirty);
-
-            // CHỈ SWAP OUT NẾU VICTIM LÀ DIRTY
-            if (vic_is_dirty) {
-                /* ROUND ROBIN TRÊN MẢNG SWAP */
-                int found_swp_id = -1;
-                for (int i = 0; i < PAGING_MAX_MMSWP; i++) {
-                    int swp_idx = (caller->krnl->active_mswp_id + i) % PAGING_MAX_MMSWP;
-                    if (caller->krnl->mswp[swp_idx] != NULL && 
-                        MEMPHY_get_freefp(caller->krnl->mswp[swp_idx], &swpfpn) == 0) {
-                        found_swp_id = swp_idx;
-                        caller->krnl->active_mswp_id = (swp_idx + 1) % PAGING_MAX_MMSWP;
-                        break;
-                    }
-                }
-
-                if (found_swp_id == -1) {
-                    printf("ERROR: ALL SWAP DEVICES ARE FULL!\n");
-                    return -1;
-                }
-                printf("Free SWAP frame obtained at SWAP %d: swpfpn=%lu\n", found_swp_id, swpfpn);
-
-                // Swap Out: RAM -> SWAP được chọn
-                printf("SWAP OUT: RAM(%lu) -> SWAP %d(%lu) because dirty=1\n", 
-                       vicfpn, found_swp_id, swpfpn);
-                regs.a1 = SYSMEM_SWP_OP;
-                regs.a2 = vicfpn;
-                regs.a3 = swpfpn;
-                regs.a4 = 0;            // Direction OUT
-                regs.a5 = found_swp_id;
-                syscall(caller->krnl, caller->pid, 17, &regs);
-
-                // Update victim PTE với đúng ID vùng swap
-                pte_set_swap(vic_owner, vicpgn, found_swp_id, swpfpn);
-                
-                // TLB COHERENCE: Invalidate victim TLB entry
-                if (vic_owner->krnl->tlb) {
-                    tlb_invalidate_entry(vic_owner->krnl->tlb, vicpgn, vic_owner->pid);
-                    printf("  Invalidated TLB entry for swapped out victim: VPN %lu (PID=%d)\n",
-                           vicpgn, vic_owner->pid);
-                }
-                
-                printf("Updated VICTIM PTE (PID=%d, pgn=%lu) to point to SWAP %d(%lu)\n",
-                        vic_owner->pid, vicpgn, found_swp_id, swpfpn);
-            } else {
-                printf("VICTIM is CLEAN (dirty=0), no need to write to SWAP\n");
-                // Chỉ cần invalidate PTE của victim
-                pte_set_entry(vic_owner, vicpgn, 0);
-                
-                // TLB COHERENCE: Invalidate clean victim TLB entry
-                if (vic_owner->krnl->tlb) {
-                    tlb_invalidate_entry(vic_owner->krnl->tlb, vicpgn, vic_owner->pid);
-                    printf("  Invalidated TLB entry for clean victim: VPN %lu (PID=%d)\n",
-                           vicpgn, vic_owner->pid);
-                }
-                
-                printf("Invalidated VICTIM PTE (PID=%d, pgn=%lu)\n",
-                        vic_owner->pid, vicpgn);
-            }
-
-            // Dùng lại frame vật lý của nạn nhân
-            tgtfpn = vicfpn;
             printf("Victim frame %lu now available for new page\n", tgtfpn);
 
             if (is_swapped) 
             {
-                printf("SWAP IN: SWAP %d(%lu) -> RAM(%lu)\n",
-                        old_swp_id, old_swpfpn, tgtfpn);
-                regs.a1 = SYSMEM_SWP_OP;
-                regs.a2 = old_swpfpn;
-                regs.a3 = tgtfpn;
-                regs.a4 = 1;          // Direction IN
-                regs.a5 = old_swp_id;
-                syscall(caller->krnl, caller->pid, 17, &regs);
-
-                MEMPHY_put_freefp(caller->krnl->mswp[old_swp_id], old_swpfpn);
-                printf("Freed swap frame %lu back to SWAP %d\n", old_swpfpn, old_swp_id);
-                
-                // SWAP IN: dirty = 0
-                pte_set_fpn(caller, pgn, tgtfpn, 0);
+                int dirty = swap_in_frame(caller, old_pte, tgtfpn);
+                pte_set_fpn(caller, pgn, tgtfpn, dirty);
                 
                 // TLB COHERENCE: Invalidate TLB entry after swap in
                 if (caller->krnl->tlb) {
@@ -459,10 +773,11 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
                            pgn, caller->pid);
                 }
                 
-                printf("Updated PTE for pgn=%d -> fpn=%lu (dirty=0, swap in)\n", pgn, tgtfpn);
+                printf("Updated PTE for pgn=%d -> fpn=%lu (dirty=%d, swap in)\n", pgn, tgtfpn, dirty);
             } else {
                 printf("New page allocated to RAM frame %lu\n", tgtfpn);
-                // TẠO MỚI: dirty = 1
+                // TẠO MỚI: dirty = 1, the frame may hold an old page
+                zero_fill_frame(caller->krnl->mram, tgtfpn);
                 pte_set_fpn(caller, pgn, tgtfpn, 1);
                 
                 // TLB COHERENCE: Invalidate TLB entry for new page
@@ -477,15 +792,19 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
         }
         
         // Enlist vào danh sách FIFO
-        enlist_pgn_node(&caller->krnl->mm->fifo_pgn, pgn, caller);
+        enlist_pgn_node(caller->krnl->mm, pgn, caller);
         printf("Added pgn=%d (PID=%d) to FIFO list\n", pgn, caller->pid);
+        if (is_swapped) {
+            swpra_faults++;
+            swap_readahead(caller, pgn);
+        }
         
         *fpn = (int)tgtfpn;
     } else {
         /*
          * Trường hợp trang ĐÃ PRESENT (đã được khởi tạo/ánh xạ trong bảng trang)
          */
-        int is_swapped = (old_pte & PAGING_PTE_SWAPPED_MASK);
+        int is_swapped = (old_pte & PAGING_PTE_SWAPPED_MASK) ? 1 : 0;
 
         if (is_swapped) 
         {
@@ -494,86 +813,25 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
              */
             printf("Page is present but currently SWAPPED OUT. Triggering Swap-In...\n");
             
-            addr_t old_swpfpn = PAGING_SWP(old_pte);
-            int old_swp_id = PAGING_PTE_GET_SWPTYP(old_pte);
             addr_t tgtfpn;
-            struct sc_regs regs;
 
             // 1. Tìm frame trống trong RAM
-            if (MEMPHY_get_freefp(caller->krnl->mram, &tgtfpn) != 0) 
+            if (ram_get_freefp(caller->krnl, &tgtfpn) != 0) 
             {
                 // Nếu RAM đầy, phải chọn nạn nhân để Swap Out
-                addr_t vicpgn, vicfpn, swpfpn;
-                uint32_t vicpte;
-                struct pcb_t *vic_owner;
-
-                if (find_victim_page(caller->krnl->mm, &vicpgn, &vic_owner) == -1) {
-                    printf("ERROR: Cannot find victim page\n");
+                if (evict_victim_frame(caller, &tgtfpn) != 0)
                     return -1;
-                }
-
-                vicpte = pte_get_entry(vic_owner, vicpgn);
-                vicfpn = PAGING_FPN(vicpte);
-                int vic_is_dirty = PAGING_PTE_GET_DIRTY(vicpte);
-
-                // CHỈ SWAP OUT NẾU DIRTY
-                if (vic_is_dirty) {
-                    /* ROUND ROBIN TRÊN MẢNG SWAP */
-                    int found_swp_id = -1;
-                    for (int i = 0; i < PAGING_MAX_MMSWP; i++) {
-                        int swp_idx = (caller->krnl->active_mswp_id + i) % PAGING_MAX_MMSWP;
-                        if (caller->krnl->mswp[swp_idx] != NULL && 
-                            MEMPHY_get_freefp(caller->krnl->mswp[swp_idx], &swpfpn) == 0) {
-                            found_swp_id = swp_idx;
-                            caller->krnl->active_mswp_id = (swp_idx + 1) % PAGING_MAX_MMSWP;
-                            break;
-                        }
-                    }
-                    if (found_swp_id == -1) return -1;
-
-                    regs.a1 = SYSMEM_SWP_OP; 
-                    regs.a2 = vicfpn; 
-                    regs.a3 = swpfpn;
-                    regs.a4 = 0;             // OUT
-                    regs.a5 = found_swp_id;
-                    syscall(caller->krnl, caller->pid, 17, &regs);
-
-                    pte_set_swap(vic_owner, vicpgn, found_swp_id, swpfpn);
-                    
-                    // TLB COHERENCE: Invalidate victim TLB entry
-                    if (vic_owner->krnl->tlb) {
-                        tlb_invalidate_entry(vic_owner->krnl->tlb, vicpgn, vic_owner->pid);
-                        printf("  Invalidated TLB entry for swapped out victim: VPN %lu (PID=%d)\n",
-                               vicpgn, vic_owner->pid);
-                    }
-                } else {
-                    // Clean victim, no swap needed
-                    pte_set_entry(vic_owner, vicpgn, 0);
-                    
-                    // TLB COHERENCE: Invalidate clean victim TLB entry
-                    if (vic_owner->krnl->tlb) {
-                        tlb_invalidate_entry(vic_owner->krnl->tlb, vicpgn, vic_owner->pid);
-                        printf("  Invalidated TLB entry for clean victim: VPN %lu (PID=%d)\n",
-                               vicpgn, vic_owner->pid);
-                    }
-                }
-
-                tgtfpn = vicfpn;
+            }
+            else
+            {
+                ksm_note_alloc(caller->krnl->ksm, 1);
             }
 
-            // 2. Đưa trang từ Swap về RAM
-            regs.a1 = SYSMEM_SWP_OP;
-            regs.a2 = old_swpfpn;
-            regs.a3 = tgtfpn;
-            regs.a4 = 1;          // IN
-            regs.a5 = old_swp_id;
-            syscall(caller->krnl, caller->pid, 17, &regs);
-
-            // 3. Trả lại slot Swap cũ và cập nhật PTE
-            MEMPHY_put_freefp(caller->krnl->mswp[old_swp_id], old_swpfpn);
-            
-            // SWAP IN: dirty = 0
-            pte_set_fpn(caller, pgn, tgtfpn, 0);
+            // 2. Đưa trang từ Swap về RAM, slot cũ ở lại trong swap cache
+            int dirty = swap_in_frame(caller, old_pte, tgtfpn);
+
+            // Cập nhật PTE
+            pte_set_fpn(caller, pgn, tgtfpn, dirty);
             
             // TLB COHERENCE: Invalidate TLB entry for swapped-in page
             if (caller->krnl->tlb) {
@@ -583,7 +841,9 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
             }
             
             // 4. Đưa vào danh sách FIFO
-            enlist_pgn_node(&caller->krnl->mm->fifo_pgn, pgn, caller);
+            enlist_pgn_node(caller->krnl->mm, pgn, caller);
+            swpra_faults++;
+            swap_readahead(caller, pgn);
             
             *fpn = (int)tgtfpn;
         } 
@@ -593,6 +853,13 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
              * TRƯỜNG HỢP: Trang thực sự đang nằm trong RAM
              */
             printf("Page already in RAM\n");
+            if (old_pte & PAGING_PTE_RA_MASK) {
+                /* First touch of a page readahead brought in */
+                CLRBIT(old_pte, PAGING_PTE_RA_MASK);
+                SETBIT(old_pte, PAGING_PTE_REFERENCED_MASK);
+                pte_set_entry(caller, pgn, old_pte);
+                swpra_hits++;
+            }
             *fpn = PAGING_FPN(old_pte);
         }
     }
@@ -621,9 +888,11 @@ int pg_getval(struct mm_struct *mm, addr_t addr, BYTE *data, struct pcb_t *calle
         fpn = tlb_fpn;
         
         /* Update reference bit in PTE */
-        uint32_t pte = pte_get_entry(caller, pgn);
-        SETBIT(pte, PAGING_PTE_REFERENCED_MASK);
-        pte_set_entry(caller, pgn, pte);
+        addr_t pte = pte_get_entry(caller, pgn);
+        if (PAGING_PAGE_PRESENT(pte)) {
+            SETBIT(pte, PAGING_PTE_REFERENCED_MASK);
+            pte_set_entry(caller, pgn, pte);
+        }
         
         /* Update referenced bit in TLB */
         tlb_set_referenced(caller->krnl->tlb, pgn, caller->pid);
@@ -631,11 +900,19 @@ int pg_getval(struct mm_struct *mm, addr_t addr, BYTE *data, struct pcb_t *calle
         /* TLB MISS - go through normal page lookup */
         printf("  TLB MISS for VPN %lu\n", pgn);
         
-        if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+        addr_t old_pte = pte_get_entry(caller, pgn);
+        if ((old_pte & PAGING_PTE_ZERO_MASK) &&
+            caller->krnl->zero_fpn != (addr_t)-1) {
+            /* Untouched page, reading the zero frame costs no frame */
+            if (!PAGING_PAGE_PRESENT(old_pte) &&
+                pte_map_zero(caller, pgn, caller->krnl->zero_fpn) != 0)
+                return -1;
+            fpn = (int)caller->krnl->zero_fpn;
+        } else if (pg_getpage(mm, pgn, &fpn, caller) != 0)
             return -1;
         
         /* Update reference bit */
-        uint32_t pte = pte_get_entry(caller, pgn);
+        addr_t pte = pte_get_entry(caller, pgn);
         SETBIT(pte, PAGING_PTE_REFERENCED_MASK);
         pte_set_entry(caller, pgn, pte);
         
@@ -643,14 +920,18 @@ int pg_getval(struct mm_struct *mm, addr_t addr, BYTE *data, struct pcb_t *calle
         if (caller->krnl->tlb) {
             int dirty = PAGING_PTE_GET_DIRTY(pte);
             int referenced = 1; /* Just accessed */
-            tlb_insert(caller->krnl->tlb, pgn, fpn, caller->pid, 
-                      dirty, referenced);
+            if (pte & PAGING_PTE_HUGE_MASK)
+                tlb_insert_huge(caller->krnl->tlb, pgn, fpn, caller->pid,
+                                dirty, referenced);
+            else
+                tlb_insert(caller->krnl->tlb, pgn, fpn, caller->pid, 
+                          dirty, referenced);
             printf("  Inserted into TLB: VPN %lu -> FPN %u\n", pgn, fpn);
         }
     }
     
     /* Calculate physical address and read */
-    addr_t phyaddr = (fpn * PAGING64_PAGESZ) + off;
+    addr_t phyaddr = ((addr_t)fpn * PAGING64_PAGESZ) + off;
     struct sc_regs regs;
     regs.a1 = SYSMEM_IO_READ;
     regs.a2 = phyaddr;
@@ -664,6 +945,44 @@ int pg_getval(struct mm_struct *mm, addr_t addr, BYTE *data, struct pcb_t *calle
     return 0;
 }
 
+/*ksm_break_cow - give the writer of a merged page its own frame
+ *@caller: writer
+ *@pgn: page number
+ *@pte: its PTE, mapping a shared frame
+ *@fpn: the frame to write to on return
+ *
+ * The last mapping of a shared frame keeps it, the others get a copy.
+ */
+static int ksm_break_cow(struct pcb_t *caller, addr_t pgn, addr_t pte, int *fpn)
+{
+    struct ksm_struct *ksm = caller->krnl->ksm;
+    addr_t oldfpn = PAGING_FPN(pte), newfpn = oldfpn;
+
+    if (ksm_refs(ksm, oldfpn) > 1) {
+        /* Shared frames are never victims, the old one stays put */
+        if (ram_get_freefp(caller->krnl, &newfpn) != 0 &&
+            evict_victim_frame(caller, &newfpn) != 0)
+            return -1;
+        MEMPHY_copy_page(caller->krnl->mram, oldfpn, caller->krnl->mram, newfpn);
+        ksm->nr_cow++;
+    } else {
+        ksm->nr_unshared++;
+    }
+    ksm_put(ksm, oldfpn);
+
+    SETVAL(pte, newfpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+    CLRBIT(pte, PAGING_PTE_KSM_MASK);
+    pte_set_entry(caller, pgn, pte);
+    MEMPHY_set_fdesc(caller->krnl->mram, newfpn, caller, pgn, FRAME_ANON);
+    if (caller->krnl->tlb)
+        tlb_invalidate_entry(caller->krnl->tlb, pgn, caller->pid);
+    printf("  KSM: PID=%d pgn=%lu unshared, fpn %lu -> %lu\n",
+           caller->pid, pgn, oldfpn, newfpn);
+
+    *fpn = (int)newfpn;
+    return 0;
+}
+
 /*pg_setval - write value to given offset */
 int pg_setval(struct mm_struct *mm, addr_t addr, BYTE value, struct pcb_t *caller)
 {
@@ -683,7 +1002,21 @@ int pg_setval(struct mm_struct *mm, addr_t addr, BYTE value, struct pcb_t *calle
         fpn = tlb_fpn;
         
         /* Update reference and dirty bits in PTE */
-        uint32_t pte = pte_get_entry(caller, pgn);
+        addr_t pte = pte_get_entry(caller, pgn);
+        if (!PAGING_PAGE_PRESENT(pte) || (pte & PAGING_PTE_ZERO_MASK)) {
+            /* First write to a page read from the zero frame */
+            if (pg_getpage(mm, pgn, &fpn, caller) != 0)
+                return -1;
+            pte = pte_get_entry(caller, pgn);
+        }
+        if (pte & PAGING_PTE_KSM_MASK) {
+            if (ksm_break_cow(caller, pgn, pte, &fpn) != 0)
+                return -1;
+            pte = pte_get_entry(caller, pgn);
+        }
+        /* The cached swap slot stops being a copy */
+        if (!(pte & PAGING_PTE_DIRTY_MASK))
+            swap_cache_drop(caller->krnl, fpn);
         SETBIT(pte, PAGING_PTE_REFERENCED_MASK);
         SETBIT(pte, PAGING_PTE_DIRTY_MASK);
         pte_set_entry(caller, pgn, pte);
@@ -699,20 +1032,31 @@ int pg_setval(struct mm_struct *mm, addr_t addr, BYTE value, struct pcb_t *calle
             return -1;
         
         /* Update reference and dirty bits in PTE */
-        uint32_t pte = pte_get_entry(caller, pgn);
+        addr_t pte = pte_get_entry(caller, pgn);
+        if (pte & PAGING_PTE_KSM_MASK) {
+            if (ksm_break_cow(caller, pgn, pte, &fpn) != 0)
+                return -1;
+            pte = pte_get_entry(caller, pgn);
+        }
+        /* The cached swap slot stops being a copy */
+        if (!(pte & PAGING_PTE_DIRTY_MASK))
+            swap_cache_drop(caller->krnl, fpn);
         SETBIT(pte, PAGING_PTE_REFERENCED_MASK);
         SETBIT(pte, PAGING_PTE_DIRTY_MASK);
         pte_set_entry(caller, pgn, pte);
         
         /* INSERT INTO TLB with dirty=1 (write operation) */
         if (caller->krnl->tlb) {
-            tlb_insert(caller->krnl->tlb, pgn, fpn, caller->pid, 1, 1);
+            if (pte & PAGING_PTE_HUGE_MASK)
+                tlb_insert_huge(caller->krnl->tlb, pgn, fpn, caller->pid, 1, 1);
+            else
+                tlb_insert(caller->krnl->tlb, pgn, fpn, caller->pid, 1, 1);
             printf("  Inserted into TLB: VPN %lu -> FPN %u (dirty=1)\n", pgn, fpn);
         }
     }
     
     /* Calculate physical address and write */
-    addr_t phyaddr = (fpn * PAGING64_PAGESZ) + off;
+    addr_t phyaddr = ((addr_t)fpn * PAGING64_PAGESZ) + off;
     struct sc_regs regs;
     regs.a1 = SYSMEM_IO_WRITE;
     regs.a2 = phyaddr;
@@ -818,76 +1162,360 @@ printf("%s:%d\n", __func__, __LINE__);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); // print max TBL
 #endif
-  MEMPHY_dump(proc->krnl->mram);
+  MEMPHY_dump_dirty(proc->krnl->mram);
 #endif
 
   return val;
 }
 
-/*free_pcb_memphy - collect all memphy of pcb
- *@caller: caller
- *@vmaid: ID vm area to alloc memory region
- *@incpgnum: number of page
- */
-int free_pcb_memph(struct pcb_t *caller)
+/* Frames freed by an exiting process, returned to MEMPHY in bulk */
+#define FP_BATCH_SZ 64
+
+struct fp_batch {
+  struct memphy_struct *mp;
+  addr_t fpn[FP_BATCH_SZ];
+  int nr;
+  int total;
+};
+
+struct exit_ctx {
+  struct fp_batch ram;
+  struct fp_batch swp[PAGING_MAX_MMSWP];
+  struct zswap_pool *zswp;
+  int nr_zswp;
+  struct ksm_struct *ksm;
+  int nr_ksm;
+  int nr_huge;
+};
+
+static void fp_batch_flush(struct fp_batch *b)
 {
-  int pagenum, fpn;
-  uint32_t pte;
+  if (b->nr > 0)
+    MEMPHY_put_freefp_batch(b->mp, b->fpn, b->nr);
+  b->nr = 0;
+}
 
-  /* 1. Giải phóng các khung trang vật lý (RAM và SWAP) */
-  for (pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
-  {
-    pte = pte_get_entry(caller, pagenum);
+static void fp_batch_add(struct fp_batch *b, addr_t fpn)
+{
+  if (b->mp == NULL)
+    return;
+  b->fpn[b->nr++] = fpn;
+  b->total++;
+  if (b->nr == FP_BATCH_SZ)
+    fp_batch_flush(b);
+}
 
-    if (PAGING_PAGE_PRESENT(pte))
+/* Release the RAM or SWAP frame backing one PTE */
+static int __free_pte_frame(addr_t *pte, addr_t pgn, void *arg)
+{
+  struct exit_ctx *ctx = (struct exit_ctx *)arg;
+  addr_t val = *pte;
+
+  if (PAGING64_PMD_IS_HUGE(val))
+  {
+    /* 2MB page, the PMD entry holds its first frame */
+    MEMPHY_put_freefp_range(ctx->ram.mp, PAGING_FPN(val), PAGING64_HUGE_NRPAGES);
+    ctx->ram.total += PAGING64_HUGE_NRPAGES;
+    ctx->nr_huge++;
+  }
+  else if (PAGING_PAGE_PRESENT(val) && (val & PAGING_PTE_ZERO_MASK))
+  {
+    zero_frame_unmap(ctx->ram.mp, val);
+  }
+  else if (PAGING_PAGE_PRESENT(val))
+  {
+    if (val & PAGING_PTE_SWAPPED_MASK)
+    {
+      int swptyp = PAGING_PTE_GET_SWPTYP(val);
+      if (swptyp < PAGING_MAX_MMSWP)
+        fp_batch_add(&ctx->swp[swptyp], PAGING_SWP(val));
+      else if (swptyp == PAGING_ZSWP_ID && zswap_invalidate(ctx->zswp, PAGING_SWP(val)) == 0)
+        ctx->nr_zswp++;
+    }
+    else if ((val & PAGING_PTE_KSM_MASK) && ksm_put(ctx->ksm, PAGING_FPN(val)) > 0)
     {
-      fpn = PAGING_FPN(pte);
-      MEMPHY_put_freefp(caller->krnl->mram, fpn);
+      ctx->nr_ksm++; /* still mapped by other pages */
     }
-    else if (pte != 0) // Chỉ giải phóng nếu PTE có dữ liệu
+    else
     {
-      fpn = PAGING_SWP(pte);
-      if (fpn != 0)
-        MEMPHY_put_freefp(caller->krnl->mswp[PAGING_PTE_GET_SWPTYP(pte)], fpn);
+      addr_t fpn = PAGING_FPN(val);
+      struct frame_desc *fd = MEMPHY_fdesc(ctx->ram.mp, fpn);
+
+      /* The slot the swap cache kept goes with the frame */
+      if (fd != NULL && fd->swp != 0) {
+        fp_batch_add(&ctx->swp[PAGING_PTE_GET_SWPTYP(fd->swp)], PAGING_SWP(fd->swp));
+        fd->swp = 0;
+      }
+      fp_batch_add(&ctx->ram, fpn);
     }
   }
+  __atomic_store_n(pte, 0, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+/*free_pcb_memph - give back everything the address space of pcb holds
+ *@caller: an exiting process, it must not run again
+ *
+ * The CLOCK nodes of caller go first, taken from its own list so the
+ * cost follows the size of caller and not the length of the CLOCK list,
+ * and no victim search can pick a page of caller while its tables are
+ * torn down. Only the populated subtrees of the page table are walked,
+ * the frames are batched per device and the tables are freed at the end
+ * of the same walk.
+ */
+int free_pcb_memph(struct pcb_t *caller)
+{
+  struct mm_struct *kmm = caller->krnl->mm;
+  struct exit_ctx ctx;
+  int nr_pgn = 0, sit;
 
-  /* 2. Dọn dẹp danh sách FIFO toàn cục */
-  printf("Cleaning up FIFO nodes for PID=%d\n", caller->pid);
-  struct pgn_t *curr = caller->krnl->mm->fifo_pgn;
-  struct pgn_t *prev = NULL;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.ram.mp = caller->krnl->mram;
+  for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+    ctx.swp[sit].mp = caller->krnl->mswp[sit];
+  ctx.zswp = caller->krnl->zswp;
+  ctx.ksm = caller->krnl->ksm;
 
-  while (curr != NULL)
+  pthread_mutex_lock(&mmvm_lock);
+
+  /* 1. Gỡ các nút CLOCK của tiến trình khỏi danh sách toàn cục */
+  while (caller->mm->own_pgn != NULL)
   {
-    if (curr->owner == caller)
-    {
-      struct pgn_t *tmp = curr;
-      if (prev == NULL)
-      {
-        caller->krnl->mm->fifo_pgn = curr->pg_next;
-        curr = caller->krnl->mm->fifo_pgn;
-      }
-      else
-      {
-        prev->pg_next = curr->pg_next;
-        curr = curr->pg_next;
-      }
-      free(tmp);
-    }
-    else
-    {
-      prev = curr;
-      curr = curr->pg_next;
+    delist_pgn_node(kmm, caller->mm->own_pgn);
+    nr_pgn++;
+  }
+
+  /* 2. Giải phóng các khung trang vật lý (RAM và SWAP) và bảng trang */
+  pgtbl_teardown(caller->mm, __free_pte_frame, &ctx);
+  /* Slots of the swap cluster no page used */
+  if (caller->mm->swpc_left > 0 && ctx.swp[caller->mm->swpc_id].mp != NULL)
+    MEMPHY_put_freefp_range(ctx.swp[caller->mm->swpc_id].mp,
+                            caller->mm->swpc_next, caller->mm->swpc_left);
+  caller->mm->swpc_left = 0;
+
+  if (caller->krnl->tlb)
+    tlb_invalidate_process(caller->krnl->tlb, caller->pid);
+
+  fp_batch_flush(&ctx.ram);
+  for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+    fp_batch_flush(&ctx.swp[sit]);
+
+  pthread_mutex_unlock(&mmvm_lock);
+
+  int nr_swp = ctx.nr_zswp;
+  for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+    nr_swp += ctx.swp[sit].total;
+  printf("PID=%d exit: %d RAM frames (%d in 2MB pages), %d swap frames, %d CLOCK nodes freed, %d shared frames kept\n",
+         caller->pid, ctx.ram.total, ctx.nr_huge * PAGING64_HUGE_NRPAGES, nr_swp, nr_pgn, ctx.nr_ksm);
+
+  return 0;
+}
+
+/* End of a KSM pass: the candidates of the pass are dropped */
+static void ksm_end_pass(struct ksm_struct *ksm)
+{
+  if (ksm->pass_pages > 0)
+    ksm->nr_pass++;
+  ksm->pass_pages = 0;
+  ksm_drop_candidates(ksm);
+}
+
+/*libksm_scan - one batch of the same-page merging scanner
+ *@krnl: kernel
+ *@budget: CLOCK list pages to look at
+ *
+ * The cursor is a node of the CLOCK list, kept like the CLOCK hand:
+ * delist_pgn_node moves it on when its node goes. A pass runs from the
+ * head to the tail of the list, a batch costs budget pages whatever the
+ * length of the list.
+ */
+int libksm_scan(struct krnl_t *krnl, int budget)
+{
+  struct ksm_struct *ksm = krnl->ksm;
+  struct mm_struct *kmm = krnl->mm;
+  struct pgn_t *pg;
+  int nr = 0;
+
+  if (ksm == NULL)
+    return 0;
+
+  pthread_mutex_lock(&mmvm_lock);
+  /* The hand fell off the tail since the last batch */
+  if (kmm->ksm_hand == NULL && ksm->pass_pages > 0)
+    ksm_end_pass(ksm);
+  pg = (kmm->ksm_hand != NULL) ? kmm->ksm_hand : kmm->fifo_pgn;
+  /* Merging leaves the CLOCK list alone */
+  while (pg != NULL && nr < budget) {
+    ksm_scan_page(ksm, pg->owner, pg->pgn);
+    nr++;
+    pg = pg->pg_next;
+    if (pg == kmm->fifo_pgn)
+      pg = NULL;
+  }
+  ksm->pass_pages += nr;
+  kmm->ksm_hand = pg;
+  if (pg == NULL)
+    ksm_end_pass(ksm);
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return nr;
+}
+
+/*libkswapd_reclaim - one wakeup of the background reclaimer
+ *@krnl: kernel
+ *
+ * Below the low watermark, CLOCK victims are evicted and their frames
+ * freed until the high watermark, KSWAPD_BATCH of them per wakeup at
+ * most. Faults then find free frames and only reclaim directly under
+ * the min watermark.
+ * Return: frames freed
+ */
+int libkswapd_reclaim(struct krnl_t *krnl)
+{
+  struct memphy_struct *mram = krnl->mram;
+  int nr_free, nr = 0;
+  unsigned long t0;
+  addr_t fpn;
+
+  if (mram == NULL)
+    return 0;
+
+  pthread_mutex_lock(&mmvm_lock);
+  kswapd_slots++;
+  nr_free = MEMPHY_nr_freefp(mram);
+  if (nr_free < WMARK_LOW(mram) && krnl->mm->nr_pgn > 0) {
+    kswapd_wakeups++;
+    t0 = reclaim_now_ns();
+    while (nr_free + nr < WMARK_HIGH(mram) && nr < KSWAPD_BATCH &&
+           __evict_victim(krnl, NULL, &fpn) == 0) {
+      MEMPHY_put_freefp(mram, fpn);
+      nr++;
     }
+    reclaim_bg += nr;
+    reclaim_bg_ns += reclaim_now_ns() - t0;
   }
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return nr;
+}
+
+/*writeback_page - copy a dirty page to a swap slot ahead of its eviction
+ *@krnl: kernel
+ *@pg: CLOCK node of the page
+ *@pte: its PTE
+ *
+ * The page turns clean and its frame keeps the slot in the swap cache,
+ * evicting it later is a PTE update without a write. A write before that
+ * drops the slot again (pg_setval). Only swap devices take pre-cleaned
+ * pages, a zswap copy would stay in RAM next to the page.
+ */
+static int writeback_page(struct krnl_t *krnl, struct pgn_t *pg, addr_t pte)
+{
+  addr_t fpn = PAGING_FPN(pte), slot;
+  int swp_id;
+
+  if (swap_slot_get(krnl, pg->owner->mm, &swp_id, &slot) != 0)
+    return -1;
+
+  printf("WRITEBACK: PID=%d pgn=%lu RAM(%lu) -> SWAP %d(%lu)\n",
+         pg->owner->pid, pg->pgn, fpn, swp_id, slot);
+  __mm_swap_page(pg->owner, fpn, slot, 0, swp_id);
+  swap_cache_drop(krnl, fpn);
+  if (swap_cache_add(krnl, fpn, swp_id, slot) != 0)
+    return -1; /* nowhere to keep the slot, the page stays dirty */
+  pgn_node_clear_bits(pg, PAGING_PTE_DIRTY_MASK);
+  /* The TLB copy of the dirty bit goes too */
+  if (krnl->tlb)
+    tlb_invalidate_entry(krnl->tlb, pg->pgn, pg->owner->pid);
 
   return 0;
 }
 
+/*libwriteback_scan - one wakeup of the writeback thread
+ *@krnl: kernel
+ *
+ * Under memory pressure (free frames below WB_START_PCT of RAM), looks
+ * at the WB_SCAN_AHEAD pages the CLOCK hand reaches next and writes the
+ * dirty, unreferenced ones to swap: those are the next victims. At most
+ * WB_MAX_PAGES are written per time slot.
+ * Return: pages written
+ */
+int libwriteback_scan(struct krnl_t *krnl)
+{
+  struct mm_struct *kmm = krnl->mm;
+  struct pgn_t *pg;
+  int nr = 0, nr_seen = 0;
+
+  if (krnl->mram == NULL)
+    return 0;
+
+  pthread_mutex_lock(&mmvm_lock);
+  wb_slots++;
+  /* Starts before kswapd has to evict, even on a small RAM */
+  if (MEMPHY_nr_freefp(krnl->mram) >= reclaim_wmark(krnl->mram, WB_START_PCT, 4)) {
+    pthread_mutex_unlock(&mmvm_lock);
+    return 0;
+  }
+  wb_active++;
+
+  pg = (kmm->clock_hand != NULL) ? kmm->clock_hand : kmm->fifo_pgn;
+  for (; pg != NULL && nr_seen < kmm->nr_pgn && nr_seen < WB_SCAN_AHEAD;
+       pg = pg->pg_next, nr_seen++) {
+    addr_t pte = pgn_node_pte(pg);
+
+    if (!PAGING_PAGE_PRESENT(pte) || !(pte & PAGING_PTE_DIRTY_MASK) ||
+        (pte & (PAGING_PTE_SWAPPED_MASK | PAGING_PTE_KSM_MASK |
+                PAGING_PTE_ZERO_MASK | PAGING_PTE_HUGE_MASK |
+                PAGING_PTE_REFERENCED_MASK)))
+      continue;
+    if (nr >= WB_MAX_PAGES) {
+      wb_throttled++;
+      break;
+    }
+    if (writeback_page(krnl, pg, pte) != 0)
+      break;
+    nr++;
+  }
+  wb_scanned += nr_seen;
+  wb_written += nr;
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return nr;
+}
+
+void writeback_print_stats(void)
+{
+  printf("===== WRITEBACK =====\n");
+  printf("Pages written ahead of eviction: %lu, %lu looked at, active in %lu of %lu time slots\n",
+         wb_written, wb_scanned, wb_active, wb_slots);
+  printf("Rate limit: %d pages per time slot, hit in %lu time slots\n",
+         WB_MAX_PAGES, wb_throttled);
+  printf("Victims: %lu clean, %lu dirty written out on eviction\n",
+         reclaim_clean, reclaim_dirty);
+  printf("=====================\n");
+}
+
+void reclaim_print_stats(void)
+{
+  printf("===== PAGE RECLAIM =====\n");
+  printf("Direct reclaim: %lu evictions in faulting processes, %.3f ms, longest %.3f ms\n",
+         reclaim_direct, reclaim_direct_ns / 1e6, reclaim_direct_max_ns / 1e6);
+  printf("Background reclaim: %lu evictions by kswapd, %.3f ms, %lu wakeups in %lu time slots\n",
+         reclaim_bg, reclaim_bg_ns / 1e6, kswapd_wakeups, kswapd_slots);
+  if (reclaim_direct + reclaim_bg > 0)
+    printf("Evictions done in the background: %.1f%%\n",
+           100.0 * reclaim_bg / (reclaim_direct + reclaim_bg));
+  printf("========================\n");
+}
+
 /*find_victim_page - find victim page using CLOCK (Second Chance) algorithm
  *@mm: memory region
  *@retpgn: return page number
  *@ret_owner: return page owner
+ *
+ * The hand sweeps the list once at most, each page costs one load of
+ * its cached PTE and unlinking the victim is O(1).
  */
 int find_victim_page(struct mm_struct *mm, addr_t *retpgn, struct pcb_t **ret_owner)
 {
@@ -904,22 +1532,15 @@ int find_victim_page(struct mm_struct *mm, addr_t *retpgn, struct pcb_t **ret_ow
     }
     
     current = mm->clock_hand;
-    struct pgn_t *start = current;
+    int nr_left = mm->nr_pgn;
     
-    printf("\n=== CLOCK Algorithm Searching (List length: ");
-    // Tính độ dài danh sách
-    int list_len = 0;
-    struct pgn_t *temp = mm->fifo_pgn;
-    while (temp != NULL) {
-        list_len++;
-        temp = temp->pg_next;
-    }
-    printf("%d) ===\n", list_len);
+    printf("\n=== CLOCK Algorithm Searching (List length: %d) ===\n", mm->nr_pgn);
     
-    do {
-        uint32_t pte = pte_get_entry(current->owner, current->pgn);
+    while (nr_left-- > 0 && current != NULL) {
+        addr_t pte = pgn_node_pte(current);
         int present = PAGING_PTE_GET_PRESENT(pte);
         int referenced = PAGING_PTE_GET_REFERENCED(pte);
+        int shared = (pte & PAGING_PTE_KSM_MASK) ? 1 : 0;
         
         printf("Checking pgn=%lu (PID=%d): present=%d, referenced=%d\n",
                current->pgn, current->owner->pid, present, referenced);
@@ -927,73 +1548,49 @@ int find_victim_page(struct mm_struct *mm, addr_t *retpgn, struct pcb_t **ret_ow
         if (!present) {
             printf("  -> Page not in RAM, removing from list\n");
             // Xóa node này khỏi danh sách
-            struct pgn_t *prev = NULL;
-            struct pgn_t *iter = mm->fifo_pgn;
-            while (iter != NULL && iter != current) {
-                prev = iter;
-                iter = iter->pg_next;
-            }
-            if (prev == NULL) {
-                mm->fifo_pgn = current->pg_next;
-            } else {
-                prev->pg_next = current->pg_next;
-            }
-            struct pgn_t *next = current->pg_next;
-            free(current);
-            current = (next != NULL) ? next : mm->fifo_pgn;
+            mm->clock_hand = current;
+            delist_pgn_node(mm, current);
+            current = mm->clock_hand;
             continue;
         }
         
-        if (referenced == 0) {
+        if (shared) {
+            /* A merged frame stays until its last mapping goes */
+            printf("  -> Shared (KSM) page, skipped\n");
+        } else if (referenced == 0) {
             // Found victim
             *retpgn = current->pgn;
             *ret_owner = current->owner;
             found = 1;
             printf("  -> Selected as victim (ref=0)\n");
             
-            // Xóa victim khỏi danh sách
-            struct pgn_t *prev = NULL;
-            struct pgn_t *iter = mm->fifo_pgn;
-            while (iter != NULL && iter != current) {
-                prev = iter;
-                iter = iter->pg_next;
-            }
-            
-            if (prev == NULL) {
-                mm->fifo_pgn = current->pg_next;
-                mm->clock_hand = (current->pg_next != NULL) ? current->pg_next : mm->fifo_pgn;
-            } else {
-                prev->pg_next = current->pg_next;
-                mm->clock_hand = (current->pg_next != NULL) ? current->pg_next : mm->fifo_pgn;
-            }
-            
-            free(current);
+            // Xóa victim khỏi danh sách, kim đồng hồ sang trang kế tiếp
+            mm->clock_hand = current;
+            delist_pgn_node(mm, current);
             break;
         } else {
             printf("  -> Giving second chance, clearing reference bit\n");
-            CLRBIT(pte, PAGING_PTE_REFERENCED_MASK);
-            pte_set_entry(current->owner, current->pgn, pte);
+            pgn_node_clear_bits(current, PAGING_PTE_REFERENCED_MASK);
         }
         
         current = current->pg_next;
-        if (current == NULL) {
-            current = mm->fifo_pgn;
-        }
-
         mm->clock_hand = current;
-        
-    } while (current != start && !found);
+    }
     
     if (!found && mm->fifo_pgn != NULL) {
         printf("All pages had ref=1, taking first page as victim\n");
         current = mm->fifo_pgn;
-        *retpgn = current->pgn;
-        *ret_owner = current->owner;
-        
-        mm->fifo_pgn = current->pg_next;
-        mm->clock_hand = (current->pg_next != NULL) ? current->pg_next : mm->fifo_pgn;
-        free(current);
-        found = 1;
+        nr_left = mm->nr_pgn;
+        while (nr_left-- > 0 && (pgn_node_pte(current) & PAGING_PTE_KSM_MASK))
+            current = current->pg_next;
+        if (nr_left >= 0) {
+            *retpgn = current->pgn;
+            *ret_owner = current->owner;
+
+            mm->clock_hand = current;
+            delist_pgn_node(mm, current);
+            found = 1;
+        }
     }
     
     if (found) {
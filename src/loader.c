@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "mm64.h"
+#include "libmem.h"
 
 static uint32_t avail_pid = 1;
 
@@ -54,12 +55,13 @@ struct pcb_t * load(const char * path) {
 		printf("Cannot find process description at '%s'\n", path);
 		exit(1);		
 	}
-	snprintf(proc->path, 2*sizeof(path)+1, "%s", path);
+	proc->path = strdup(path);
 	char opcode[10];
 	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
 	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
+	/* Zeroed so that a bare "calc" leaves its arguments at 0 */
+	proc->code->text = (struct inst_t*)calloc(
+		proc->code->size, sizeof(struct inst_t)
 	);
 	uint32_t i = 0;
 	char buf[200];
@@ -113,8 +115,19 @@ struct pcb_t * load(const char * path) {
 			exit(1);
 		}
 	}
+	fclose(file);
 	return proc;
 }
 
-
-
+/* Release a finished process and everything load() gave it */
+void unload(struct pcb_t * proc) {
+#ifdef MM_PAGING
+	free_pcb_memph(proc);
+	free_mm(proc->mm);
+#endif
+	free(proc->code->text);
+	free(proc->code);
+	free(proc->page_table);
+	free(proc->path);
+	free(proc);
+}
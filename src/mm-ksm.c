@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * PAGING based Memory Management
+ * Same-page merging mm/mm-ksm.c
+ *
+ * The scanner hashes the resident pages of the CLOCK list. A page whose
+ * content did not change since the previous pass is looked up among the
+ * stable (shared) frames, then among the candidates of the current
+ * pass. A byte-identical match remaps the page onto the shared frame
+ * with PAGING_PTE_KSM_MASK and its own frame goes back to RAM.
+ *
+ * Shared frames are never picked as victims, a write fault gives the
+ * writer a private copy (libmem.c). The mapping count of a shared frame
+ * and the mapper of a candidate are read from the frame descriptors, a
+ * candidate whose frame changed hands is simply rejected. The caller
+ * holds the mmvm lock.
+ */
+
+#include "mm.h"
+#include "mm64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KSM_NR_WORDS (PAGING64_PAGESZ / sizeof(uint64_t))
+
+static uint64_t __ksm_hash(const uint64_t *w)
+{
+   uint64_t h = 0xcbf29ce484222325ULL;
+   int i;
+
+   for (i = 0; i < KSM_NR_WORDS; i++) {
+      h ^= w[i];
+      h *= 0x100000001b3ULL;
+      h ^= h >> 29;
+   }
+   return h;
+}
+
+static BYTE *__ksm_frame(struct ksm_struct *ksm, addr_t fpn)
+{
+   return ksm->mram->storage + fpn * PAGING64_PAGESZ;
+}
+
+/* Is the page of PTE pte a private anonymous 4KB page in RAM */
+static int __ksm_mergeable(addr_t pte)
+{
+   if (!PAGING_PAGE_PRESENT(pte))
+      return 0;
+   return !(pte & (PAGING_PTE_SWAPPED_MASK | PAGING_PTE_HUGE_MASK |
+                   PAGING_PTE_KSM_MASK | PAGING_PTE_ZERO_MASK));
+}
+
+/* __ksm_map - point the page at the shared frame of it */
+static void __ksm_map(struct ksm_struct *ksm, struct pcb_t *owner, addr_t pgn,
+                      addr_t pte, struct ksm_item *it)
+{
+   addr_t oldfpn = PAGING_FPN(pte);
+
+   /* Shared frames are never swapped out, dirty has no meaning there */
+   SETVAL(pte, it->fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+   SETBIT(pte, PAGING_PTE_KSM_MASK);
+   CLRBIT(pte, PAGING_PTE_DIRTY_MASK);
+   pte_set_entry(owner, pgn, pte);
+   if (owner->krnl->tlb)
+      tlb_invalidate_entry(owner->krnl->tlb, pgn, owner->pid);
+
+   MEMPHY_fdesc(ksm->mram, it->fpn)->ref++;
+   if (oldfpn != it->fpn) {
+      ksm->frame[oldfpn].csum = 0;
+      swap_cache_drop(owner->krnl, oldfpn);
+      MEMPHY_put_freefp(ksm->mram, oldfpn);
+      ksm->nr_merged++;
+      ksm->nr_saved++;
+      if (ksm->nr_saved > ksm->peak_saved)
+         ksm->peak_saved = ksm->nr_saved;
+   }
+}
+
+/*
+ *  ksm_init - merging state for the frames of mram
+ */
+struct ksm_struct *ksm_init(struct memphy_struct *mram)
+{
+   struct ksm_struct *ksm = calloc(1, sizeof(struct ksm_struct));
+
+   if (ksm == NULL)
+      return NULL;
+   ksm->mram = mram;
+   ksm->frame = calloc(mram->maxsz / PAGING64_PAGESZ, sizeof(struct ksm_frame));
+   if (ksm->frame == NULL) {
+      free(ksm);
+      return NULL;
+   }
+
+   return ksm;
+}
+
+/*
+ *  ksm_scan_page - try to merge page pgn of owner
+ *
+ *  Returns 1 when the page now maps a shared frame.
+ */
+int ksm_scan_page(struct ksm_struct *ksm, struct pcb_t *owner, addr_t pgn)
+{
+   uint64_t page[KSM_NR_WORDS];
+   struct ksm_item *it, **pp;
+   addr_t pte = pte_get_entry(owner, pgn);
+   addr_t fpn;
+   uint64_t h;
+   uint32_t csum;
+   int b;
+
+   if (!__ksm_mergeable(pte))
+      return 0;
+   fpn = PAGING_FPN(pte);
+   if (MEMPHY_read_page(ksm->mram, fpn, (BYTE *)page) != 0)
+      return 0;
+   ksm->nr_scanned++;
+
+   /* Pages still being written would be unshared right away */
+   h = __ksm_hash(page);
+   csum = (uint32_t)(h ^ (h >> 32));
+   if (ksm->frame[fpn].csum != csum) {
+      ksm->frame[fpn].csum = csum;
+      ksm->nr_volatile++;
+      return 0;
+   }
+
+   b = h % KSM_HASH_SZ;
+   for (it = ksm->stable[b]; it != NULL; it = it->next) {
+      if (it->hash == h && memcmp(page, __ksm_frame(ksm, it->fpn), PAGING64_PAGESZ) == 0) {
+         __ksm_map(ksm, owner, pgn, pte, it);
+         return 1;
+      }
+   }
+
+   for (pp = &ksm->unstable[b]; (it = *pp) != NULL; pp = &it->next) {
+      struct frame_desc *cfd;
+      addr_t cpte;
+
+      if (it->hash != h || it->fpn == fpn)
+         continue;
+      /* The candidate may have been freed, swapped out or written since */
+      cfd = MEMPHY_fdesc(ksm->mram, it->fpn);
+      if (cfd == NULL || cfd->state != FRAME_ANON || cfd->owner == NULL)
+         continue;
+      cpte = pte_get_entry(cfd->owner, cfd->pgn);
+      if (!__ksm_mergeable(cpte) || PAGING_FPN(cpte) != it->fpn ||
+          memcmp(page, __ksm_frame(ksm, it->fpn), PAGING64_PAGESZ) != 0)
+         continue;
+
+      /* Promote the candidate frame to a stable one */
+      struct pcb_t *cowner = cfd->owner;
+      addr_t cpgn = cfd->pgn;
+
+      *pp = it->next;
+      MEMPHY_set_fdesc(ksm->mram, it->fpn, NULL, 0, FRAME_KSM);
+      it->next = ksm->stable[b];
+      ksm->stable[b] = it;
+      ksm->frame[it->fpn].stable = it;
+      ksm->nr_shared++;
+      __ksm_map(ksm, cowner, cpgn, cpte, it);
+      __ksm_map(ksm, owner, pgn, pte, it);
+      return 1;
+   }
+
+   it = malloc(sizeof(struct ksm_item));
+   if (it == NULL)
+      return 0;
+   it->hash = h;
+   it->fpn = fpn;
+   it->next = ksm->unstable[b];
+   ksm->unstable[b] = it;
+
+   return 0;
+}
+
+/* ksm_drop_candidates - forget the candidates of the current pass */
+void ksm_drop_candidates(struct ksm_struct *ksm)
+{
+   int b;
+
+   if (ksm == NULL)
+      return;
+   for (b = 0; b < KSM_HASH_SZ; b++) {
+      while (ksm->unstable[b] != NULL) {
+         struct ksm_item *it = ksm->unstable[b];
+         ksm->unstable[b] = it->next;
+         free(it);
+      }
+   }
+}
+
+/* ksm_refs - PTEs mapping frame fpn, 0 when it is not shared */
+int ksm_refs(struct ksm_struct *ksm, addr_t fpn)
+{
+   if (ksm == NULL || ksm->frame[fpn].stable == NULL)
+      return 0;
+   return MEMPHY_fdesc(ksm->mram, fpn)->ref;
+}
+
+/*
+ *  ksm_put - one PTE stops mapping shared frame fpn
+ *
+ *  Returns the mappings left. At 0 the frame is not shared anymore and
+ *  belongs to the caller, which keeps or frees it.
+ */
+int ksm_put(struct ksm_struct *ksm, addr_t fpn)
+{
+   struct ksm_item *it, **pp;
+   struct frame_desc *fd;
+
+   if (ksm == NULL || (it = ksm->frame[fpn].stable) == NULL)
+      return 0;
+   fd = MEMPHY_fdesc(ksm->mram, fpn);
+   if (--fd->ref > 0) {
+      ksm->nr_saved--;
+      return fd->ref;
+   }
+
+   for (pp = &ksm->stable[it->hash % KSM_HASH_SZ]; *pp != it; pp = &(*pp)->next)
+      ;
+   *pp = it->next;
+   ksm->frame[fpn].stable = NULL;
+   ksm->frame[fpn].csum = 0;
+   ksm->nr_shared--;
+   free(it);
+
+   return 0;
+}
+
+/*
+ *  ksm_note_alloc - nr frames were just taken from the free list
+ *
+ *  Without merging there would be nr_saved frames less, the part of the
+ *  allocation beyond what would have been free counts as evictions (and
+ *  swap-outs for dirty victims) avoided.
+ */
+void ksm_note_alloc(struct ksm_struct *ksm, int nr)
+{
+   long nr_free, deficit;
+
+   if (ksm == NULL || nr <= 0 || ksm->nr_saved == 0)
+      return;
+   nr_free = MEMPHY_nr_freefp(ksm->mram);
+   deficit = (long)ksm->nr_saved - nr_free;
+   if (deficit > 0)
+      ksm->nr_avoided += (deficit < nr) ? deficit : nr;
+}
+
+void ksm_print_stats(struct ksm_struct *ksm)
+{
+   printf("===== KSM STATISTICS =====\n");
+   printf("Scanned: %lu pages in %lu passes, %lu still changing\n",
+          ksm->nr_scanned, ksm->nr_pass, ksm->nr_volatile);
+   printf("Merged: %lu pages, %lu shared frames now\n", ksm->nr_merged, ksm->nr_shared);
+   printf("Frames saved: %lu now, %lu at peak (%lu KB)\n",
+          ksm->nr_saved, ksm->peak_saved, ksm->peak_saved * PAGING64_PAGESZ / 1024);
+   printf("Write faults: %lu private copies, %lu last mappings kept the frame\n",
+          ksm->nr_cow, ksm->nr_unshared);
+   printf("Swap-outs avoided: %lu victims that did not have to be evicted\n", ksm->nr_avoided);
+   printf("==========================\n");
+}
+
+void ksm_free(struct ksm_struct *ksm)
+{
+   int b;
+
+   if (ksm == NULL)
+      return;
+   ksm_drop_candidates(ksm);
+   for (b = 0; b < KSM_HASH_SZ; b++) {
+      while (ksm->stable[b] != NULL) {
+         struct ksm_item *it = ksm->stable[b];
+         ksm->stable[b] = it->next;
+         free(it);
+      }
+   }
+   free(ksm->frame);
+   free(ksm);
+}
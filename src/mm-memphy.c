@@ -20,30 +20,93 @@
 #include <string.h>
 #include "mm64.h"
 #include <pthread.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
-static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+/* CPU of the calling thread, -1 outside the CPU threads */
+static __thread int memphy_cpu = -1;
+
+void MEMPHY_set_cpu(int cpu)
+{
+   memphy_cpu = cpu;
+}
+
+/*
+ * NUMA nodes. The node list is short, a linear search is enough.
+ */
+static struct memphy_struct *__node_of(struct memphy_struct *mp, addr_t fpn)
+{
+   int i;
+
+   for (i = 0; i < mp->nr_node; i++) {
+      struct memphy_struct *n = &mp->node[i];
+      if (fpn >= n->base_fpn && fpn - n->base_fpn < (addr_t)n->nr_fp)
+         return n;
+   }
+   return NULL;
+}
+
+static int __node_is_local(struct memphy_struct *n)
+{
+   return memphy_cpu >= n->cpu_first && memphy_cpu <= n->cpu_last;
+}
+
+/* __node_first - the node allocations of this CPU try first */
+static int __node_first(struct memphy_struct *mp)
+{
+   int i;
+
+   for (i = 0; i < mp->nr_node; i++)
+      if (__node_is_local(&mp->node[i]))
+         return i;
+   return 0;
+}
+
+/* __numa_access - charge an access to byte addr of mp to its node */
+static void __numa_access(struct memphy_struct *mp, addr_t addr)
+{
+   struct memphy_struct *n;
+
+   if (mp->nr_node == 0 || memphy_cpu < 0)
+      return;
+   n = __node_of(mp, addr / PAGING64_PAGESZ);
+   if (n == NULL)
+      return;
+   if (__node_is_local(n)) {
+      __atomic_fetch_add(&n->nr_local, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&n->numa_ns, n->access_ns, __ATOMIC_RELAXED);
+   } else {
+      __atomic_fetch_add(&n->nr_remote, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&n->numa_ns, n->access_ns + MEMPHY_NUMA_REMOTE_NS, __ATOMIC_RELAXED);
+   }
+}
 
 /*
  *  MEMPHY_mv_csr - move MEMPHY cursor
  *  @mp: memphy struct
  *  @offset: offset
+ *
+ *  The cursor lands on offset directly, the travel from its old
+ *  position is charged to the device seek model: a fixed cost per
+ *  seek plus a cost per KB of distance, in simulated ns.
  */
 int MEMPHY_mv_csr(struct memphy_struct *mp, addr_t offset)
 {
-   int numstep = 0;
+   addr_t target = (offset < mp->maxsz) ? offset : 0;
+   addr_t dist = (target > mp->cursor) ? target - mp->cursor : mp->cursor - target;
 
-   mp->cursor = 0;
-   while (numstep < offset && numstep < mp->maxsz)
-   {
-      /* Traverse sequentially */
-      mp->cursor = (mp->cursor + 1) % mp->maxsz;  // cursor moves step by step
-      numstep++;
+   if (dist > 0) {
+      mp->nr_seeks++;
+      mp->seek_bytes += dist;
+      mp->seek_ns += mp->seek_fixed_ns + dist * mp->seek_ns_per_kb / 1024;
    }
+   mp->cursor = target;
 
    return 0;
 }
 
-
 /*
  *  MEMPHY_seq_read - read MEMPHY device
  *  @mp: memphy struct
@@ -55,8 +118,10 @@ int MEMPHY_seq_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
    if (mp == NULL)
       return -1;
 
-   if (!mp->rdmflg)
+   if (mp->rdmflg)
       return -1; /* Not compatible mode for sequential read */
+   if (addr >= mp->maxsz)
+      return -1; // boundary check
 
    MEMPHY_mv_csr(mp, addr);  // move cursor to the address
    *value = (BYTE)mp->storage[addr];  // read byte at the address
@@ -64,6 +129,19 @@ int MEMPHY_seq_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
    return 0;
 }
 
+/* __mark_written - frames of [addr, addr + len) changed, for the dumps */
+static void __mark_written(struct memphy_struct *mp, addr_t addr, addr_t len)
+{
+   addr_t fpn;
+
+   if (mp->wr_bitmap == NULL)
+      return;
+   for (fpn = addr / PAGING64_PAGESZ; fpn <= (addr + len - 1) / PAGING64_PAGESZ; fpn++) {
+      __atomic_fetch_or(&mp->wr_bitmap[BIT_ULL_WORD(fpn)], BIT_ULL_MASK(fpn), __ATOMIC_RELAXED);
+      __atomic_fetch_or(&mp->dirty_bitmap[BIT_ULL_WORD(fpn)], BIT_ULL_MASK(fpn), __ATOMIC_RELAXED);
+   }
+}
+
 /*
  *  MEMPHY_read read MEMPHY device
  *  @mp: memphy struct
@@ -75,8 +153,12 @@ int MEMPHY_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
    if (mp == NULL)
       return -1;
 
-   if (mp->rdmflg) //  check if RAM, damflag = 1
+   if (mp->rdmflg && addr >= mp->maxsz)
+      return -1; // boundary check
+   if (mp->rdmflg) { //  check if RAM, damflag = 1
       *value = mp->storage[addr]; // direct read
+      __numa_access(mp, addr);
+   }
    else /* Sequential access device */
       return MEMPHY_seq_read(mp, addr, value); 
 
@@ -95,12 +177,13 @@ int MEMPHY_seq_write(struct memphy_struct *mp, addr_t addr, BYTE value)
    if (mp == NULL)
       return -1;
 
-   if (!mp->rdmflg)
-      return -1; /* Not compatible mode for sequential read */
+   if (mp->rdmflg)
+      return -1; /* Not compatible mode for sequential write */
+   if (addr >= mp->maxsz) return -1; // boundary check
 
    MEMPHY_mv_csr(mp, addr);
-   if (addr < 0 || addr >= mp->maxsz) return -1; // boundary check
    mp->storage[addr] = value;
+   __mark_written(mp, addr, 1);
 
    return 0;
 }
@@ -119,135 +202,1094 @@ int MEMPHY_write(struct memphy_struct *mp, addr_t addr, BYTE data)
    if (mp->storage == NULL)     // ← Kiểm tra storage!
       return -1;
       
-   if (mp->rdmflg && addr < mp->maxsz)  // ←  Kiểm tra addr bounds!
+   if (mp->rdmflg && addr < mp->maxsz) {  // ←  Kiểm tra addr bounds!
       mp->storage[addr] = data;
-   else
+      __mark_written(mp, addr, 1);
+      __numa_access(mp, addr);
+   } else
       return MEMPHY_seq_write(mp, addr, data);
    
    return 0;
 }
 
+/*
+ *  MEMPHY_read_page - read the whole frame fpn
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @buf: PAGING64_PAGESZ bytes
+ *
+ *  A sequential device seeks once to the frame, then streams it.
+ */
+int MEMPHY_read_page(struct memphy_struct *mp, addr_t fpn, BYTE *buf)
+{
+   addr_t addr = fpn * PAGING64_PAGESZ;
+
+   if (mp == NULL || mp->storage == NULL || addr + PAGING64_PAGESZ > mp->maxsz)
+      return -1;
+
+   if (!mp->rdmflg) {
+      MEMPHY_mv_csr(mp, addr);
+      mp->cursor = (addr + PAGING64_PAGESZ) % mp->maxsz;
+   }
+   memcpy(buf, mp->storage + addr, PAGING64_PAGESZ);
+   __numa_access(mp, addr);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_write_page - overwrite the whole frame fpn
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @buf: PAGING64_PAGESZ bytes
+ */
+int MEMPHY_write_page(struct memphy_struct *mp, addr_t fpn, const BYTE *buf)
+{
+   addr_t addr = fpn * PAGING64_PAGESZ;
+
+   if (mp == NULL || mp->storage == NULL || addr + PAGING64_PAGESZ > mp->maxsz)
+      return -1;
+
+   if (!mp->rdmflg) {
+      MEMPHY_mv_csr(mp, addr);
+      mp->cursor = (addr + PAGING64_PAGESZ) % mp->maxsz;
+   }
+   memcpy(mp->storage + addr, buf, PAGING64_PAGESZ);
+   __mark_written(mp, addr, PAGING64_PAGESZ);
+   __numa_access(mp, addr);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_copy_page - copy frame srcfpn of src to frame dstfpn of dst
+ *
+ *  Straight from storage to storage when both sides are random
+ *  access, through a page buffer otherwise.
+ */
+int MEMPHY_copy_page(struct memphy_struct *src, addr_t srcfpn,
+                     struct memphy_struct *dst, addr_t dstfpn)
+{
+   BYTE buf[PAGING64_PAGESZ];
+
+   if (src == NULL || dst == NULL || src->storage == NULL || dst->storage == NULL)
+      return -1;
+
+   if (src->rdmflg && dst->rdmflg) {
+      addr_t srcaddr = srcfpn * PAGING64_PAGESZ;
+      addr_t dstaddr = dstfpn * PAGING64_PAGESZ;
+      if (srcaddr + PAGING64_PAGESZ > src->maxsz || dstaddr + PAGING64_PAGESZ > dst->maxsz)
+         return -1;
+      memmove(dst->storage + dstaddr, src->storage + srcaddr, PAGING64_PAGESZ);
+      __mark_written(dst, dstaddr, PAGING64_PAGESZ);
+      __numa_access(src, srcaddr);
+      __numa_access(dst, dstaddr);
+      return 0;
+   }
+
+   if (MEMPHY_read_page(src, srcfpn, buf) != 0)
+      return -1;
+   return MEMPHY_write_page(dst, dstfpn, buf);
+}
+
+/*
+ * Frame allocator helpers, all called with fp_lock held.
+ * Frames from fp_hiwater up were never handed out: they are free but
+ * not on the stack, so the stack and fp_pos only grow with the part of
+ * the device actually in use.
+ */
+#define FP_BITMAP_TEST(mp, fpn) \
+   ((mp)->fp_bitmap[BIT_ULL_WORD(fpn)] & BIT_ULL_MASK(fpn))
+
+/* __fp_grow - make room in fp_stack and fp_pos for frames below hiwater */
+static int __fp_grow(struct memphy_struct *mp, int hiwater)
+{
+   int cap = mp->fp_cap;
+   addr_t *stack;
+   int *pos;
+
+   if (hiwater <= cap)
+      return 0;
+   while (cap < hiwater)
+      cap = (cap > 0) ? cap * 2 : 1024;
+   if (cap > mp->nr_fp)
+      cap = mp->nr_fp;
+
+   stack = realloc(mp->fp_stack, cap * sizeof(addr_t));
+   if (stack == NULL)
+      return -1;
+   mp->fp_stack = stack;
+   pos = realloc(mp->fp_pos, cap * sizeof(int));
+   if (pos == NULL)
+      return -1;
+   mp->fp_pos = pos;
+   mp->fp_cap = cap;
+   return 0;
+}
+
+/* __fp_push - put a free frame on top of the stack */
+static void __fp_push(struct memphy_struct *mp, addr_t fpn)
+{
+   mp->fp_stack[mp->fp_top] = fpn;
+   mp->fp_pos[fpn] = mp->fp_top++;
+   mp->fp_bitmap[BIT_ULL_WORD(fpn)] &= ~BIT_ULL_MASK(fpn);
+}
+
+/* __fp_take - take a given free frame, the top of the stack fills its
+ * slot. Above the high water mark, the frames skipped over go on the
+ * stack first. */
+static int __fp_take(struct memphy_struct *mp, addr_t fpn)
+{
+   if (fpn >= mp->fp_hiwater) {
+      if (__fp_grow(mp, fpn + 1) != 0)
+         return -1;
+      while (mp->fp_hiwater < fpn)
+         __fp_push(mp, mp->fp_hiwater++);
+      mp->fp_hiwater = fpn + 1;
+   } else {
+      int pos = mp->fp_pos[fpn];
+      addr_t last = mp->fp_stack[--mp->fp_top];
+
+      mp->fp_stack[pos] = last;
+      mp->fp_pos[last] = pos;
+   }
+   mp->fp_bitmap[BIT_ULL_WORD(fpn)] |= BIT_ULL_MASK(fpn);
+   return 0;
+}
+
+/* __fp_next - the frame a plain get hands out, -1 when none is left */
+static long __fp_next(struct memphy_struct *mp)
+{
+   if (mp->fp_top > 0)
+      return mp->fp_stack[mp->fp_top - 1];
+   if (mp->fp_hiwater < mp->nr_fp)
+      return mp->fp_hiwater;
+   return -1;
+}
+
+/*
+ * Per-CPU magazines. A CPU thread names itself with MEMPHY_set_cpu,
+ * any other thread goes straight to the stack. Lock order is the
+ * magazine lock, then fp_lock.
+ */
+#define FP_MAG_TEST(mp, fpn) \
+   (__atomic_load_n(&(mp)->mag_bitmap[BIT_ULL_WORD(fpn)], __ATOMIC_RELAXED) & BIT_ULL_MASK(fpn))
+
+static struct fp_magazine *__fp_mag(struct memphy_struct *mp)
+{
+   if (mp->mag == NULL || memphy_cpu < 0)
+      return NULL;
+   return &mp->mag[memphy_cpu % MEMPHY_NR_MAG];
+}
+
+static void __fp_mag_mark(struct memphy_struct *mp, addr_t fpn, int in)
+{
+   if (in)
+      __atomic_fetch_or(&mp->mag_bitmap[BIT_ULL_WORD(fpn)], BIT_ULL_MASK(fpn), __ATOMIC_RELAXED);
+   else
+      __atomic_fetch_and(&mp->mag_bitmap[BIT_ULL_WORD(fpn)], ~BIT_ULL_MASK(fpn), __ATOMIC_RELAXED);
+}
+
+/* __fp_mag_refill - move up to want frames from the stack into mag,
+ * at least a batch when room allows, called with mag->lock held */
+static void __fp_mag_refill(struct memphy_struct *mp, struct fp_magazine *mag, int want)
+{
+   int got = 0;
+
+   if (want < MEMPHY_MAG_BATCH)
+      want = MEMPHY_MAG_BATCH;
+   if (want > MEMPHY_MAG_SZ - mag->nr)
+      want = MEMPHY_MAG_SZ - mag->nr;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   while (got < want) {
+      long fpn = __fp_next(mp);
+      if (fpn < 0 || __fp_take(mp, fpn) != 0)
+         break;
+      __fp_mag_mark(mp, fpn, 1);
+      mag->fpn[mag->nr++] = fpn;
+      got++;
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   if (got > 0)
+      __atomic_fetch_add(&mp->mag_refill, 1, __ATOMIC_RELAXED);
+}
+
+/* __fp_mag_drain - give the nr oldest frames of mag back to the stack,
+ * called with mag->lock held */
+static void __fp_mag_drain(struct memphy_struct *mp, struct fp_magazine *mag, int nr)
+{
+   int i;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   for (i = 0; i < nr; i++) {
+      __fp_mag_mark(mp, mag->fpn[i], 0);
+      __fp_push(mp, mag->fpn[i]);
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   mag->nr -= nr;
+   memmove(mag->fpn, mag->fpn + nr, mag->nr * sizeof(addr_t));
+}
+
+/* __fp_mag_flush - empty every magazine of mp, when the stack alone
+ * cannot serve a request. Return: number of frames given back */
+static int __fp_mag_flush(struct memphy_struct *mp)
+{
+   int m, nr = 0;
+
+   if (mp->mag == NULL)
+      return 0;
+
+   for (m = 0; m < MEMPHY_NR_MAG; m++) {
+      struct fp_magazine *mag = &mp->mag[m];
+
+      pthread_mutex_lock(&mag->lock);
+      nr += mag->nr;
+      if (mag->nr > 0)
+         __fp_mag_drain(mp, mag, mag->nr);
+      pthread_mutex_unlock(&mag->lock);
+   }
+
+   if (nr > 0)
+      __atomic_fetch_add(&mp->mag_flush, 1, __ATOMIC_RELAXED);
+   return nr;
+}
+
+/* __fp_put_ok - fpn belongs to mp, is allocated and not cached */
+static int __fp_put_ok(struct memphy_struct *mp, addr_t fpn)
+{
+   if (fpn >= mp->nr_fp || !FP_BITMAP_TEST(mp, fpn))
+      return 0;
+   return mp->mag_bitmap == NULL || !FP_MAG_TEST(mp, fpn);
+}
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
+ *
+ *  The free frames are kept as a stack of frame numbers, next to an
+ *  allocation bitmap and the stack slot of each frame. Get and put
+ *  never touch the heap once the stack has grown to the working set.
  */
 int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
    /* This setting come with fixed constant PAGESZ */
-   int numfp = mp->maxsz / pagesz; // ← Number of frames = Total size / Page size
-   //("So luong frame trong RAM: %d\n",numfp);
+   addr_t numfp = mp->maxsz / pagesz; // ← Number of frames = Total size / Page size
 
-   struct framephy_struct *newfst, *fst; 
-   int iter = 0;
+   mp->nr_fp = 0;
+   mp->fp_top = 0;
+   mp->fp_cap = 0;
+   mp->fp_hiwater = 0;
+   if (numfp == 0 || numfp > INT_MAX)
+      return -1;
 
-   if (numfp <= 0)
+   mp->fp_bitmap = calloc(DIV_ROUND_UP(numfp, BITS_PER_LONG_LONG), sizeof(uint64_t));
+   if (mp->fp_bitmap == NULL)
       return -1;
+   mp->nr_fp = numfp;
 
-   /* Init head of free framephy list */
-   fst = malloc(sizeof(struct framephy_struct)); 
-   fst->fpn = iter;
-   fst->fp_next = NULL;
-   mp->free_fp_list = fst;
+   /* Frame 0 is handed out first */
+   return 0;
+}
 
-   /* We have list with first element, fill in the rest num-1 element member*/
-   
-   
-   for (iter = 1; iter < numfp; iter++)
-   {
-      newfst = malloc(sizeof(struct framephy_struct));
-      newfst->fpn = iter;
-      newfst->fp_next = NULL;
-      fst->fp_next = newfst;
-      fst = newfst;
+static int __fp_get(struct memphy_struct *mp, addr_t *retfpn)
+{
+   pthread_mutex_lock(&mp->fp_lock);
+   long fpn = __fp_next(mp);
+   if (fpn < 0 || __fp_take(mp, fpn) != 0){
+      pthread_mutex_unlock(&mp->fp_lock);
+      return -1;
    }
-   
-   // mp->used_fp_list = NULL; // ← Khởi tạo used list
 
+   *retfpn = fpn;//retfpn = frame number
+   pthread_mutex_unlock(&mp->fp_lock);
    return 0;
 }
 
+/*
+ * NUMA dispatch: the local node of the calling CPU first, then the
+ * following nodes in turn. Frames a node hands out to a CPU it is not
+ * local to are counted as fallbacks.
+ */
+static int __node_get_freefp(struct memphy_struct *mp, addr_t *retfpn)
+{
+   int first = __node_first(mp), k;
+
+   for (k = 0; k < mp->nr_node; k++) {
+      struct memphy_struct *n = &mp->node[(first + k) % mp->nr_node];
+
+      if (MEMPHY_get_freefp(n, retfpn) == 0) {
+         *retfpn += n->base_fpn;
+         if (!__node_is_local(n))
+            __atomic_fetch_add(&n->nr_fallback, 1, __ATOMIC_RELAXED);
+         return 0;
+      }
+   }
+   return -1;
+}
+
+static int __node_get_freefp_n(struct memphy_struct *mp, int nr, addr_t *retfpns)
+{
+   int first = __node_first(mp), k, i = 0;
+
+   for (k = 0; k < mp->nr_node && i < nr; k++) {
+      struct memphy_struct *n = &mp->node[(first + k) % mp->nr_node];
+      int got = MEMPHY_get_freefp_n(n, nr - i, retfpns + i);
+
+      if (got > 0 && !__node_is_local(n))
+         __atomic_fetch_add(&n->nr_fallback, got, __ATOMIC_RELAXED);
+      for (; got > 0; got--)
+         retfpns[i++] += n->base_fpn;
+   }
+   return i;
+}
+
 int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *retfpn)
 {
-   pthread_mutex_lock(&mm_lock);
-   struct framephy_struct *fp = mp->free_fp_list; // ← Lấy frame đầu
-   if (fp == NULL){
-      pthread_mutex_unlock(&mm_lock);
-      return -1;
+   struct fp_magazine *mag = __fp_mag(mp);
+
+   if (mp->nr_node > 0)
+      return __node_get_freefp(mp, retfpn);
+
+   if (mag != NULL) {
+      pthread_mutex_lock(&mag->lock);
+      if (mag->nr == 0)
+         __fp_mag_refill(mp, mag, MEMPHY_MAG_BATCH);
+      if (mag->nr > 0) {
+         *retfpn = mag->fpn[--mag->nr];
+         __fp_mag_mark(mp, *retfpn, 0);
+         pthread_mutex_unlock(&mag->lock);
+         __atomic_fetch_add(&mp->mag_hit, 1, __ATOMIC_RELAXED);
+         return 0;
+      }
+      pthread_mutex_unlock(&mag->lock);
    }
-      
 
-   *retfpn = fp->fpn;//retfpn = frame number
-   mp->free_fp_list = fp->fp_next; // delete frame
+   if (__fp_get(mp, retfpn) == 0)
+      return 0;
+   /* Other CPUs may still cache what is left of the device */
+   if (__fp_mag_flush(mp) > 0)
+      return __fp_get(mp, retfpn);
+   return -1;
+}
 
-   /* MEMPHY is iteratively used up until its exhausted
-    * No garbage collector acting then it not been released
-    */
-   free(fp);
-   pthread_mutex_unlock(&mm_lock);
-   return 0;
+/*
+ *  MEMPHY_get_freefp_n - take up to nr free frames at once
+ *  @mp: memphy struct
+ *  @nr: number of frames wanted
+ *  @retfpns: obtained frames, room for nr
+ *
+ *  Return: number of frames obtained, fewer than nr when the device
+ *  runs out
+ */
+int MEMPHY_get_freefp_n(struct memphy_struct *mp, int nr, addr_t *retfpns)
+{
+   struct fp_magazine *mag = __fp_mag(mp);
+   int i = 0, flushed = 0;
+
+   if (mp->nr_node > 0)
+      return __node_get_freefp_n(mp, nr, retfpns);
+
+   /* Requests a magazine can hold are served from it, larger ones take
+    * fp_lock once anyway */
+   if (mag != NULL && nr <= MEMPHY_MAG_SZ) {
+      pthread_mutex_lock(&mag->lock);
+      if (mag->nr < nr)
+         __fp_mag_refill(mp, mag, nr - mag->nr);
+      while (i < nr && mag->nr > 0) {
+         retfpns[i] = mag->fpn[--mag->nr];
+         __fp_mag_mark(mp, retfpns[i++], 0);
+      }
+      pthread_mutex_unlock(&mag->lock);
+      __atomic_fetch_add(&mp->mag_hit, i, __ATOMIC_RELAXED);
+   }
+
+   do {
+      pthread_mutex_lock(&mp->fp_lock);
+      for (; i < nr; i++) {
+         long fpn = __fp_next(mp);
+         if (fpn < 0 || __fp_take(mp, fpn) != 0)
+            break;
+         retfpns[i] = fpn;
+      }
+      pthread_mutex_unlock(&mp->fp_lock);
+   } while (i < nr && !flushed++ && __fp_mag_flush(mp) > 0);
+
+   return i;
 }
 
-int MEMPHY_dump(struct memphy_struct *mp)
+/* __dump_frame - print the non-zero bytes of frame fpn */
+static int __dump_frame(struct memphy_struct *mp, addr_t fpn)
 {
-   /*TODO dump memphy content mp->storage
-    *     for tracing the memory content
-    */
-   printf("===== PHYSICAL MEMORY DUMP =====\n");
-   printf("Memory size: %d bytes\n", mp->maxsz);
-   printf("Random access: %s\n", mp->rdmflg ? "YES" : "NO");
-   
-   int i;
+   addr_t i = fpn * PAGING64_PAGESZ;
+   addr_t end = i + PAGING64_PAGESZ;
    int non_zero_found = 0;
-   
-   // Dump theo từng byte
-   for (i = 0; i < mp->maxsz; i++) {
-       if (mp->storage[i] != 0) {
-           printf("Address 0x%08x (byte %d): 0x%02x (%d decimal)\n", 
-                  i, i, (unsigned char)mp->storage[i], (unsigned char)mp->storage[i]);
-           non_zero_found++;
-       }
+
+   if (end > mp->maxsz)
+      end = mp->maxsz;
+   for (; i < end; i++) {
+      if (mp->storage[i] != 0) {
+         printf("Address 0x%08lx (byte %lu): 0x%02x (%d decimal)\n",
+                i, i, (unsigned char)mp->storage[i], (unsigned char)mp->storage[i]);
+         non_zero_found++;
+      }
    }
-   
-   if (non_zero_found == 0) {
-       printf("All memory is zero (empty)\n");
-   } else {
-       printf("Found %d non-zero bytes\n", non_zero_found);
+
+   return non_zero_found;
+}
+
+/* __dump_frames - dump the frames set in bitmap between first and last,
+ * clearing them on the way when clear is set */
+static void __dump_frames(struct memphy_struct *mp, uint64_t *bitmap, int clear,
+                          addr_t first, addr_t last)
+{
+   addr_t w, nr_fr = 0;
+   int non_zero_found = 0;
+
+   for (w = BIT_ULL_WORD(first); bitmap != NULL && w <= BIT_ULL_WORD(last); w++) {
+      uint64_t bits = clear ? __atomic_exchange_n(&bitmap[w], 0, __ATOMIC_RELAXED)
+                            : __atomic_load_n(&bitmap[w], __ATOMIC_RELAXED);
+
+      while (bits) {
+         addr_t fpn = w * BITS_PER_LONG_LONG + __builtin_ctzll(bits);
+
+         bits &= bits - 1;
+         if (fpn < first || fpn > last)
+            continue;
+         nr_fr++;
+         non_zero_found += __dump_frame(mp, fpn);
+      }
    }
-   
+
+   if (clear && nr_fr == 0)
+      printf("No frame changed since the last dump\n");
+   else if (non_zero_found == 0)
+      printf("All memory is zero (empty)\n");
+   else
+      printf("Found %d non-zero bytes in %lu frames\n", non_zero_found, nr_fr);
+}
+
+/*
+ *  MEMPHY_dump - print every non-zero byte of mp
+ *
+ *  Frames never written are still zero, only the written ones are read.
+ */
+int MEMPHY_dump(struct memphy_struct *mp)
+{
+   printf("===== PHYSICAL MEMORY DUMP =====\n");
+   printf("Memory size: %lu bytes\n", mp->maxsz);
+   printf("Random access: %s\n", mp->rdmflg ? "YES" : "NO");
+
+   if (mp->maxsz > 0)
+      __dump_frames(mp, mp->wr_bitmap, 0, 0, (mp->maxsz - 1) / PAGING64_PAGESZ);
+
    printf("===== END PHYSICAL MEMORY DUMP =====\n");
-   
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_dump_dirty - print the frames written since the last call
+ */
+int MEMPHY_dump_dirty(struct memphy_struct *mp)
+{
+   printf("===== PHYSICAL MEMORY DUMP (changed frames) =====\n");
+
+   if (mp->maxsz > 0)
+      __dump_frames(mp, mp->dirty_bitmap, 1, 0, (mp->maxsz - 1) / PAGING64_PAGESZ);
+
+   printf("===== END PHYSICAL MEMORY DUMP =====\n");
+
    return 0;
 }
 
+/*
+ *  MEMPHY_dump_range - print frames fpn to fpn + nr - 1
+ */
+int MEMPHY_dump_range(struct memphy_struct *mp, addr_t fpn, addr_t nr)
+{
+   addr_t last = (mp->maxsz + PAGING64_PAGESZ - 1) / PAGING64_PAGESZ;
+
+   if (nr == 0 || fpn >= last)
+      return -1;
+   if (nr > last - fpn)
+      nr = last - fpn;
+
+   printf("===== PHYSICAL MEMORY DUMP (frames %lu-%lu) =====\n", fpn, fpn + nr - 1);
+   __dump_frames(mp, mp->wr_bitmap, 0, fpn, fpn + nr - 1);
+   printf("===== END PHYSICAL MEMORY DUMP =====\n");
+
+   return 0;
+}
+
+/*
+ * A frame going back to the device forgets its page. A put the device
+ * is going to reject (out of range, already free or cached) leaves the
+ * descriptor alone, it may belong to a live frame.
+ */
+static void __fd_clear(struct memphy_struct *mp, addr_t fpn, int nr)
+{
+   addr_t i;
+
+   if (mp->fdesc == NULL || fpn + nr > mp->maxsz / PAGING64_PAGESZ)
+      return;
+   for (i = fpn; i < fpn + nr; i++) {
+      struct memphy_struct *n = (mp->nr_node > 0) ? __node_of(mp, i) : mp;
+      if (n != NULL && __fp_put_ok(n, i - n->base_fpn))
+         memset(&mp->fdesc[i], 0, sizeof(struct frame_desc));
+   }
+}
+
+/*
+ *  MEMPHY_fdesc - descriptor of frame fpn, NULL without a table
+ */
+struct frame_desc *MEMPHY_fdesc(struct memphy_struct *mp, addr_t fpn)
+{
+   if (mp == NULL || mp->fdesc == NULL || fpn >= mp->maxsz / PAGING64_PAGESZ)
+      return NULL;
+   return &mp->fdesc[fpn];
+}
+
+/*
+ *  MEMPHY_set_fdesc - frame fpn now backs page pgn of owner
+ *  @owner: NULL for a shared frame, which starts with no mapping
+ *
+ *  The swap cache link of a RAM frame is left alone.
+ */
+void MEMPHY_set_fdesc(struct memphy_struct *mp, addr_t fpn, struct pcb_t *owner,
+                      addr_t pgn, int state)
+{
+   struct frame_desc *fd = MEMPHY_fdesc(mp, fpn);
+
+   if (fd == NULL)
+      return;
+   fd->owner = owner;
+   fd->pgn = pgn;
+   fd->ref = (owner != NULL) ? 1 : 0;
+   fd->state = state;
+}
+
+/*
+ *  MEMPHY_frame_hist - count the frames of mp in each FRAME_ state
+ *  @hist: FRAME_NR_STATE counters
+ *  @nr_swpcache: RAM frames still linked to a swap slot
+ *  @nr_map: pages mapping the shared frames, KSM then zero
+ *
+ *  Frames on the free list count as FRAME_FREE, frames handed out without
+ *  a page as untracked. Lockless, a snapshot of a running system.
+ *  Return: untracked frames
+ */
+int MEMPHY_frame_hist(struct memphy_struct *mp, unsigned long *hist,
+                      unsigned long *nr_swpcache, unsigned long *nr_map)
+{
+   addr_t fpn, nr_frames = mp->maxsz / PAGING64_PAGESZ;
+   unsigned long nr_free = MEMPHY_nr_freefp(mp), untracked;
+
+   memset(hist, 0, FRAME_NR_STATE * sizeof(unsigned long));
+   *nr_swpcache = nr_map[0] = nr_map[1] = 0;
+   if (mp->fdesc == NULL)
+      return -1;
+
+   for (fpn = 0; fpn < nr_frames; fpn++) {
+      struct frame_desc *fd = &mp->fdesc[fpn];
+      int st = fd->state < FRAME_NR_STATE ? fd->state : FRAME_FREE;
+
+      hist[st]++;
+      if (fd->swp != 0)
+         (*nr_swpcache)++;
+      if (st == FRAME_KSM)
+         nr_map[0] += fd->ref;
+      else if (st == FRAME_ZERO)
+         nr_map[1] += fd->ref;
+   }
+
+   untracked = (hist[FRAME_FREE] > nr_free) ? hist[FRAME_FREE] - nr_free : 0;
+   hist[FRAME_FREE] = nr_free;
+   return (int)untracked;
+}
+
 int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn)
 {
-   pthread_mutex_lock(&mm_lock);
-   struct framephy_struct *fp = mp->free_fp_list;
-   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+   struct fp_magazine *mag = __fp_mag(mp);
+   int ret = 0;
+
+   __fd_clear(mp, fpn, 1);
+   if (mp->nr_node > 0) {
+      struct memphy_struct *n = __node_of(mp, fpn);
+      return n ? MEMPHY_put_freefp(n, fpn - n->base_fpn) : -1;
+   }
+
+   if (mag != NULL) {
+      if (!__fp_put_ok(mp, fpn))
+         return -1;
+      pthread_mutex_lock(&mag->lock);
+      if (mag->nr == MEMPHY_MAG_SZ) {
+         __fp_mag_drain(mp, mag, MEMPHY_MAG_BATCH);
+         __atomic_fetch_add(&mp->mag_drain, 1, __ATOMIC_RELAXED);
+      }
+      __fp_mag_mark(mp, fpn, 1);
+      mag->fpn[mag->nr++] = fpn;
+      pthread_mutex_unlock(&mag->lock);
+      return 0;
+   }
 
-   /* Create new node with value fpn */
-   newnode->fpn = fpn;
-   newnode->fp_next = fp;
-   mp->free_fp_list = newnode;
-   pthread_mutex_unlock(&mm_lock);
+   pthread_mutex_lock(&mp->fp_lock);
+   if (__fp_put_ok(mp, fpn))
+      __fp_push(mp, fpn);
+   else
+      ret = -1; /* out of the device or already free */
+   pthread_mutex_unlock(&mp->fp_lock);
+   return ret;
+}
+
+/*
+ *  MEMPHY_get_freefp_range - take nr contiguous free frames
+ *  @mp: memphy struct
+ *  @nr: number of frames
+ *  @align: the first frame is a multiple of align
+ *  @retfpn: obtained first frame
+ *
+ *  The bitmap is scanned a word at a time where the run covers whole
+ *  words, a busy frame moves the candidate to the next aligned start.
+ */
+static int __fp_get_range(struct memphy_struct *mp, int nr, int align, addr_t *retfpn)
+{
+   int numfp = mp->nr_fp;
+   int start = 0, fpn;
+
+   if (nr <= 0 || align <= 0 || nr > numfp)
+      return -1;
+
+   pthread_mutex_lock(&mp->fp_lock);
+   while (start + nr <= numfp) {
+      int end = start + nr;
+      int busy = -1;
+
+      for (fpn = start; fpn < end; ) {
+         if (fpn % BITS_PER_LONG_LONG == 0 && fpn + BITS_PER_LONG_LONG <= end) {
+            if (mp->fp_bitmap[BIT_ULL_WORD(fpn)] != 0) {
+               busy = fpn + 63 - __builtin_clzll(mp->fp_bitmap[BIT_ULL_WORD(fpn)]);
+               break;
+            }
+            fpn += BITS_PER_LONG_LONG;
+         } else {
+            if (FP_BITMAP_TEST(mp, fpn)) {
+               busy = fpn;
+               break;
+            }
+            fpn++;
+         }
+      }
+
+      if (busy < 0)
+         break;
+      start = (busy / align + 1) * align;
+   }
+
+   if (start + nr > numfp) {
+      pthread_mutex_unlock(&mp->fp_lock);
+      return -1;
+   }
+
+   for (fpn = start; fpn < start + nr; fpn++) {
+      if (__fp_take(mp, fpn) != 0) {
+         while (--fpn >= start)
+            __fp_push(mp, fpn);
+         pthread_mutex_unlock(&mp->fp_lock);
+         return -1;
+      }
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   *retfpn = start;
    return 0;
 }
 
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nr, int align, addr_t *retfpn)
+{
+   if (mp->nr_node > 0) {
+      int first = __node_first(mp), k;
+
+      /* Only nodes that keep the alignment in global frame numbers */
+      for (k = 0; k < mp->nr_node; k++) {
+         struct memphy_struct *n = &mp->node[(first + k) % mp->nr_node];
+
+         if (align > 0 && n->base_fpn % align != 0)
+            continue;
+         if (MEMPHY_get_freefp_range(n, nr, align, retfpn) == 0) {
+            *retfpn += n->base_fpn;
+            if (!__node_is_local(n))
+               __atomic_fetch_add(&n->nr_fallback, nr, __ATOMIC_RELAXED);
+            return 0;
+         }
+      }
+      return -1;
+   }
+
+   if (__fp_get_range(mp, nr, align, retfpn) == 0)
+      return 0;
+   /* Cached frames look busy in the bitmap */
+   if (__fp_mag_flush(mp) > 0)
+      return __fp_get_range(mp, nr, align, retfpn);
+   return -1;
+}
+
 /*
- *  Init MEMPHY struct
+ *  MEMPHY_put_freefp_batch - give back nr frames listed in fpns
+ *  @mp: memphy struct
+ *  @fpns: frame numbers, in any order
+ *  @nr: number of frames
+ *
+ *  A batch that fits goes to the magazine of this CPU, any other
+ *  takes fp_lock once.
+ *  Return: 0, or -1 if some frame was out of the device or already free
  */
-int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
+int MEMPHY_put_freefp_batch(struct memphy_struct *mp, addr_t *fpns, int nr)
+{
+   struct fp_magazine *mag = __fp_mag(mp);
+   int i, ret = 0;
+
+   for (i = 0; i < nr && mp->fdesc != NULL; i++)
+      __fd_clear(mp, fpns[i], 1);
+   if (mp->nr_node > 0) {
+      /* Runs of frames of the same node go down together */
+      addr_t buf[64];
+      struct memphy_struct *cur = NULL;
+      int nbuf = 0;
+
+      for (i = 0; i <= nr; i++) {
+         struct memphy_struct *n = (i < nr) ? __node_of(mp, fpns[i]) : NULL;
+
+         if (nbuf > 0 && (n != cur || nbuf == 64 || i == nr)) {
+            if (MEMPHY_put_freefp_batch(cur, buf, nbuf) != 0)
+               ret = -1;
+            nbuf = 0;
+         }
+         if (i == nr)
+            break;
+         if (n == NULL) {
+            ret = -1;
+            continue;
+         }
+         cur = n;
+         buf[nbuf++] = fpns[i] - n->base_fpn;
+      }
+      return ret;
+   }
+
+   if (mag != NULL && nr <= MEMPHY_MAG_SZ) {
+      pthread_mutex_lock(&mag->lock);
+      if (mag->nr + nr > MEMPHY_MAG_SZ) {
+         int over = mag->nr + nr - MEMPHY_MAG_SZ;
+         if (over < MEMPHY_MAG_BATCH)
+            over = (mag->nr < MEMPHY_MAG_BATCH) ? mag->nr : MEMPHY_MAG_BATCH;
+         __fp_mag_drain(mp, mag, over);
+         __atomic_fetch_add(&mp->mag_drain, 1, __ATOMIC_RELAXED);
+      }
+      for (i = 0; i < nr; i++) {
+         if (__fp_put_ok(mp, fpns[i])) {
+            __fp_mag_mark(mp, fpns[i], 1);
+            mag->fpn[mag->nr++] = fpns[i];
+         } else {
+            ret = -1;
+         }
+      }
+      pthread_mutex_unlock(&mag->lock);
+      return ret;
+   }
+
+   pthread_mutex_lock(&mp->fp_lock);
+   for (i = 0; i < nr; i++) {
+      if (__fp_put_ok(mp, fpns[i]))
+         __fp_push(mp, fpns[i]);
+      else
+         ret = -1;
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   return ret;
+}
+
+/*
+ *  MEMPHY_put_freefp_range - give back nr frames from fpn
+ */
+int MEMPHY_put_freefp_range(struct memphy_struct *mp, addr_t fpn, int nr)
+{
+   int i, ret = 0;
+
+   __fd_clear(mp, fpn, nr);
+   if (mp->nr_node > 0) {
+      struct memphy_struct *n = __node_of(mp, fpn);
+      return n ? MEMPHY_put_freefp_range(n, fpn - n->base_fpn, nr) : -1;
+   }
+
+   pthread_mutex_lock(&mp->fp_lock);
+   for (i = 0; i < nr; i++) {
+      if (__fp_put_ok(mp, fpn + i))
+         __fp_push(mp, fpn + i);
+      else
+         ret = -1;
+   }
+   pthread_mutex_unlock(&mp->fp_lock);
+
+   return ret;
+}
+
+/*
+ *  MEMPHY_nr_freefp - number of free frames on the device
+ */
+int MEMPHY_nr_freefp(struct memphy_struct *mp)
+{
+   int nr, m;
+
+   if (mp->nr_node > 0) {
+      for (nr = 0, m = 0; m < mp->nr_node; m++)
+         nr += MEMPHY_nr_freefp(&mp->node[m]);
+      return nr;
+   }
+
+   pthread_mutex_lock(&mp->fp_lock);
+   nr = mp->fp_top + (mp->nr_fp - mp->fp_hiwater);
+   pthread_mutex_unlock(&mp->fp_lock);
+   if (mp->mag != NULL)
+      for (m = 0; m < MEMPHY_NR_MAG; m++)
+         nr += __atomic_load_n(&mp->mag[m].nr, __ATOMIC_RELAXED);
+
+   return nr;
+}
+
+/* Everything but the storage, common to all backends */
+static int __init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
 {
-   mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
    mp->maxsz = max_size;
-   memset(mp->storage, 0, max_size * sizeof(BYTE));
+   pthread_mutex_init(&mp->fp_lock, NULL);
+   mp->fp_stack = NULL; /* stays empty if max_size is below a page */
+   mp->fp_pos = NULL;
+   mp->fp_bitmap = NULL;
 
    MEMPHY_format(mp, PAGING64_PAGESZ);
 
+   /* Every byte of the device, a partial last frame included */
+   addr_t nr_words = DIV_ROUND_UP(DIV_ROUND_UP(max_size, PAGING64_PAGESZ), BITS_PER_LONG_LONG);
+   mp->wr_bitmap = calloc(nr_words, sizeof(uint64_t));
+   mp->dirty_bitmap = calloc(nr_words, sizeof(uint64_t));
+   if (mp->wr_bitmap == NULL || mp->dirty_bitmap == NULL) {
+      free(mp->wr_bitmap);
+      free(mp->dirty_bitmap);
+      mp->wr_bitmap = mp->dirty_bitmap = NULL;
+   }
+   /* Untouched descriptors cost no host memory either */
+   addr_t nr_fdesc = DIV_ROUND_UP(max_size, PAGING64_PAGESZ);
+   mp->fdesc = calloc(nr_fdesc, sizeof(struct frame_desc));
+   if (mp->fdesc == NULL && nr_fdesc > 0) {
+      /* Swap cache, KSM and the frame stats all need the descriptors */
+      printf("Cannot allocate %lu frame descriptors\n", nr_fdesc);
+      free(mp->wr_bitmap);
+      free(mp->dirty_bitmap);
+      free(mp->fp_stack);
+      free(mp->fp_pos);
+      free(mp->fp_bitmap);
+      pthread_mutex_destroy(&mp->fp_lock);
+      return -1;
+   }
+
+   /* Magazines only where they cannot hoard a noticeable share */
+   mp->mag = NULL;
+   mp->mag_bitmap = NULL;
+   mp->mag_hit = mp->mag_refill = mp->mag_drain = mp->mag_flush = 0;
+#ifdef MM_FP_MAGAZINE
+   if (mp->nr_fp >= 2 * MEMPHY_NR_MAG * MEMPHY_MAG_SZ) {
+      mp->mag = calloc(MEMPHY_NR_MAG, sizeof(struct fp_magazine));
+      mp->mag_bitmap = calloc(DIV_ROUND_UP(mp->nr_fp, BITS_PER_LONG_LONG), sizeof(uint64_t));
+      if (mp->mag == NULL || mp->mag_bitmap == NULL) {
+         free(mp->mag);
+         free(mp->mag_bitmap);
+         mp->mag = NULL;
+         mp->mag_bitmap = NULL;
+      } else {
+         for (int m = 0; m < MEMPHY_NR_MAG; m++)
+            pthread_mutex_init(&mp->mag[m].lock, NULL);
+      }
+   }
+#endif
+
+   mp->node = NULL;
+   mp->nr_node = 0;
+   mp->base_fpn = 0;
+   mp->cpu_first = 0;
+   mp->cpu_last = -1;
+   mp->access_ns = 0;
+   mp->nr_local = mp->nr_remote = mp->nr_fallback = mp->numa_ns = 0;
+
    mp->rdmflg = (randomflg != 0) ? 1 : 0;
 
-   if (!mp->rdmflg) /* Not Ramdom acess device, then it serial device*/
-      mp->cursor = 0;
+   /* Not Ramdom acess device, then it serial device*/
+   mp->cursor = 0;
+   mp->seek_fixed_ns = MEMPHY_SEEK_FIXED_NS;
+   mp->seek_ns_per_kb = MEMPHY_SEEK_NS_PER_KB;
+   mp->nr_seeks = 0;
+   mp->seek_bytes = 0;
+   mp->seek_ns = 0;
+
+   return 0;
+}
+
+/*
+ *  Init MEMPHY struct
+ *
+ *  The storage is an anonymous private mapping: untouched frames read
+ *  as the host zero page and only the pages written cost host memory,
+ *  so startup no longer depends on max_size.
+ */
+int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
+{
+   void *storage = mmap(NULL, max_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+   if (storage == MAP_FAILED) {
+      printf("Cannot map %lu bytes of memory\n", max_size);
+      return -1;
+   }
+
+   mp->storage = (BYTE *)storage;
+   mp->backing_fd = -1;
+   mp->backing_path = NULL;
+   return __init_memphy(mp, max_size, randomflg);
+}
+
+/*
+ *  init_memphy_banks - RAM made of nr NUMA nodes
+ *  @banks: size, local CPUs and access cost of each node, sizes are
+ *          cut down to whole pages
+ *
+ *  The nodes share one storage, frame numbers run through the banks
+ *  in order.
+ */
+int init_memphy_banks(struct memphy_struct *mp, struct memphy_bank *banks, int nr, int randomflg)
+{
+   addr_t total = 0, base = 0;
+   int i;
+
+   if (nr <= 0 || nr > MEMPHY_MAX_NODES)
+      return -1;
+   for (i = 0; i < nr; i++)
+      total += banks[i].size / PAGING64_PAGESZ * PAGING64_PAGESZ;
+   if (init_memphy(mp, total, randomflg) != 0)
+      return -1;
+   if (nr == 1)
+      return 0;
+
+   mp->node = calloc(nr, sizeof(struct memphy_struct));
+   if (mp->node == NULL)
+      return -1;
+   for (i = 0; i < nr; i++) {
+      struct memphy_struct *n = &mp->node[i];
+      addr_t size = banks[i].size / PAGING64_PAGESZ * PAGING64_PAGESZ;
+
+      n->storage = mp->storage + base * PAGING64_PAGESZ;
+      n->backing_fd = -1;
+      n->backing_path = NULL;
+      if (__init_memphy(n, size, randomflg) != 0)
+         return -1;
+      /* The dumps, the byte accesses and the descriptors go through mp */
+      free(n->wr_bitmap);
+      free(n->dirty_bitmap);
+      free(n->fdesc);
+      n->wr_bitmap = n->dirty_bitmap = NULL;
+      n->fdesc = NULL;
+      n->base_fpn = base;
+      n->cpu_first = banks[i].cpu_first;
+      n->cpu_last = banks[i].cpu_last;
+      n->access_ns = banks[i].access_ns;
+      base += size / PAGING64_PAGESZ;
+   }
+   mp->nr_node = nr;
+
+   return 0;
+}
+
+/*
+ *  init_memphy_file - MEMPHY device stored in a host file
+ *  @path: host file, created if needed and cut back to an empty
+ *         sparse file of max_size bytes
+ *
+ *  The file is mapped shared, so host memory is only spent on the
+ *  pages the simulation touches and the host kernel can write them
+ *  back to the file. The file is removed by free_memphy unless
+ *  MM_SWAP_FILE_KEEP is set.
+ */
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg, const char *path)
+{
+   int flags = MAP_SHARED;
+   int fd = open(path, O_RDWR | O_CREAT, 0600);
+
+   if (fd < 0) {
+      printf("Cannot open swap file %s\n", path);
+      return -1;
+   }
+   if (ftruncate(fd, 0) != 0 || ftruncate(fd, max_size) != 0) {
+      printf("Cannot size swap file %s to %lu bytes\n", path, max_size);
+      close(fd);
+      return -1;
+   }
+
+#ifdef MM_SWAP_NORESERVE
+   flags |= MAP_NORESERVE;
+#endif
+   void *storage = mmap(NULL, max_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+   if (storage == MAP_FAILED) {
+      printf("Cannot map swap file %s\n", path);
+      close(fd);
+      return -1;
+   }
+
+   mp->storage = (BYTE *)storage;
+   mp->backing_fd = fd;
+   mp->backing_path = strdup(path);
+   return __init_memphy(mp, max_size, randomflg);
+}
+
+static void __free_memphy_alloc(struct memphy_struct *mp)
+{
+   free(mp->fp_stack);
+   free(mp->fp_pos);
+   free(mp->fp_bitmap);
+   pthread_mutex_destroy(&mp->fp_lock);
+   if (mp->mag != NULL)
+      for (int m = 0; m < MEMPHY_NR_MAG; m++)
+         pthread_mutex_destroy(&mp->mag[m].lock);
+   free(mp->mag);
+   free(mp->mag_bitmap);
+   free(mp->wr_bitmap);
+   free(mp->dirty_bitmap);
+   free(mp->fdesc);
+}
+
+/*
+ *  free_memphy - release the storage and the frame allocator of mp,
+ *  mp itself stays with the caller
+ */
+int free_memphy(struct memphy_struct *mp)
+{
+   int i;
+
+   munmap(mp->storage, mp->maxsz);
+   if (mp->backing_fd >= 0)
+      close(mp->backing_fd);
+#ifndef MM_SWAP_FILE_KEEP
+   if (mp->backing_path != NULL)
+      unlink(mp->backing_path);
+#endif
+   free(mp->backing_path);
+   mp->backing_path = NULL;
+   mp->storage = NULL;
+
+   __free_memphy_alloc(mp);
+   for (i = 0; i < mp->nr_node; i++)
+      __free_memphy_alloc(&mp->node[i]);
+   free(mp->node);
 
    return 0;
 }
@@ -247,7 +247,11 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz)
   /*Validate overlap of obtained region */
   if (validate_overlap_vm_area(caller, vmaid, area->rg_start, area->rg_end) <
       0)
+  {
+    free(area);
+    free(newrg);
     return -1; /*Overlap and failed allocation */
+  }
 
   /* The obtained vm area (only)
    * now will be alloc real ram region */
@@ -256,11 +260,15 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz)
                  newrg) < 0)
   {
     printf("Error: Can't mapping memory!\n");
+    free(area);
+    free(newrg);
     return -1; /* Map the memory to MEMRAM */
   }
   
   cur_vma->sbrk += inc_amt;
   cur_vma->vm_end = cur_vma->sbrk;
+  free(area);
+  free(newrg);
   return 0;
 }
 
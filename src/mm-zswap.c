@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * PAGING based Memory Management
+ * Compressed swap pool mm/mm-zswap.c
+ *
+ * A dirty victim is first offered to the pool. A page made of one
+ * repeated word only keeps that word, any other page is zero-run
+ * encoded into 64 byte chunks of a fixed arena. Pages that do not
+ * shrink to half a page, or do not fit, go to the swap devices.
+ */
+
+#include "mm.h"
+#include "mm64.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define ZSWP_CHUNK_SZ 64
+#define ZSWP_MAXLEN (PAGING64_PAGESZ / 2)
+#define ZSWP_RUN_MIN 4 /* shorter zero runs stay in the literals */
+
+/*
+ * Encoded page: records of a 16 bit zero count, a 16 bit literal count
+ * and the literals, until the page is covered.
+ */
+static int __zrl_encode(const unsigned char *src, unsigned char *dst, int cap)
+{
+   int i = 0, o = 0;
+
+   while (i < PAGING64_PAGESZ) {
+      int z = 0, l = 0, k;
+
+      while (i + z < PAGING64_PAGESZ && src[i + z] == 0)
+         z++;
+      i += z;
+
+      /* Literals run up to the next zero run worth a record */
+      while (i + l < PAGING64_PAGESZ) {
+         for (k = 0; k < ZSWP_RUN_MIN && i + l + k < PAGING64_PAGESZ; k++)
+            if (src[i + l + k] != 0)
+               break;
+         if (k == ZSWP_RUN_MIN || i + l + k == PAGING64_PAGESZ)
+            break;
+         l += k + 1;
+      }
+
+      if (o + 4 + l > cap)
+         return -1;
+      dst[o++] = z & 0xff;
+      dst[o++] = z >> 8;
+      dst[o++] = l & 0xff;
+      dst[o++] = l >> 8;
+      memcpy(dst + o, src + i, l);
+      o += l;
+      i += l;
+   }
+
+   return o;
+}
+
+static void __zrl_decode(const unsigned char *src, int len, unsigned char *dst)
+{
+   int i = 0, o = 0;
+
+   while (i < len) {
+      int z = src[i] | (src[i + 1] << 8);
+      int l = src[i + 2] | (src[i + 3] << 8);
+
+      i += 4;
+      memset(dst + o, 0, z);
+      o += z;
+      memcpy(dst + o, src + i, l);
+      o += l;
+      i += l;
+   }
+   memset(dst + o, 0, PAGING64_PAGESZ - o);
+}
+
+/* First fit for n chunks, runs do not wrap around the arena end */
+static long __chunk_alloc(struct zswap_pool *zp, uint32_t n)
+{
+   uint32_t i = zp->chunk_hint, run = 0;
+   uint32_t scanned;
+
+   for (scanned = 0; scanned < zp->nr_chunks + n; scanned++, i++) {
+      if (i >= zp->nr_chunks) {
+         i = 0;
+         run = 0;
+      }
+      if (run == 0 && (i & 63) == 0 && zp->chunk_map[i >> 6] == ~0ULL) {
+         i += 63;
+         scanned += 63;
+         continue;
+      }
+      if (zp->chunk_map[i >> 6] & (1ULL << (i & 63))) {
+         run = 0;
+         continue;
+      }
+      if (++run == n) {
+         uint32_t base = i + 1 - n, c;
+
+         for (c = base; c <= i; c++)
+            zp->chunk_map[c >> 6] |= 1ULL << (c & 63);
+         zp->chunk_hint = (i + 1) % zp->nr_chunks;
+         zp->used_chunks += n;
+         if (zp->used_chunks > zp->peak_chunks)
+            zp->peak_chunks = zp->used_chunks;
+         return base;
+      }
+   }
+
+   return -1;
+}
+
+static void __chunk_free(struct zswap_pool *zp, uint32_t base, uint32_t n)
+{
+   uint32_t c;
+
+   for (c = base; c < base + n; c++)
+      zp->chunk_map[c >> 6] &= ~(1ULL << (c & 63));
+   zp->used_chunks -= n;
+}
+
+static int __ent_alloc(struct zswap_pool *zp, uint32_t *idx)
+{
+   if (zp->nr_ent_free > 0) {
+      *idx = zp->ent_free[--zp->nr_ent_free];
+      return 0;
+   }
+
+   if (zp->nr_ent == zp->cap_ent) {
+      uint32_t cap = zp->cap_ent ? zp->cap_ent * 2 : 256;
+      struct zswap_entry *ent = realloc(zp->ent, cap * sizeof(struct zswap_entry));
+      uint32_t *ent_free = realloc(zp->ent_free, cap * sizeof(uint32_t));
+
+      if (ent != NULL)
+         zp->ent = ent;
+      if (ent_free != NULL)
+         zp->ent_free = ent_free;
+      if (ent == NULL || ent_free == NULL)
+         return -1;
+      zp->cap_ent = cap;
+   }
+
+   *idx = zp->nr_ent++;
+   return 0;
+}
+
+static void __ent_release(struct zswap_pool *zp, uint32_t idx)
+{
+   struct zswap_entry *e = &zp->ent[idx];
+
+   if (e->kind == ZSWP_ZRL)
+      __chunk_free(zp, e->chunk, (e->len + ZSWP_CHUNK_SZ - 1) / ZSWP_CHUNK_SZ);
+   e->kind = ZSWP_FREE;
+   zp->ent_free[zp->nr_ent_free++] = idx;
+}
+
+/*
+ *  zswap_init - create a pool with an arena of poolsz bytes
+ */
+struct zswap_pool *zswap_init(addr_t poolsz)
+{
+   struct zswap_pool *zp = calloc(1, sizeof(struct zswap_pool));
+
+   if (zp == NULL)
+      return NULL;
+
+   zp->nr_chunks = poolsz / ZSWP_CHUNK_SZ;
+   zp->arena = malloc((addr_t)zp->nr_chunks * ZSWP_CHUNK_SZ);
+   zp->chunk_map = calloc((zp->nr_chunks + 63) / 64, sizeof(uint64_t));
+   if (zp->nr_chunks == 0 || zp->arena == NULL || zp->chunk_map == NULL) {
+      free(zp->arena);
+      free(zp->chunk_map);
+      free(zp);
+      return NULL;
+   }
+   /* Bits past the last chunk never look free */
+   if (zp->nr_chunks & 63)
+      zp->chunk_map[zp->nr_chunks >> 6] = ~0ULL << (zp->nr_chunks & 63);
+   pthread_mutex_init(&zp->lock, NULL);
+
+   return zp;
+}
+
+/*
+ *  zswap_store - take a copy of RAM frame fpn into the pool
+ *  @zp: pool, NULL when the pool is disabled
+ *  @mram: RAM
+ *  @fpn: frame of the victim
+ *  @handle: entry index to keep in the swapped PTE
+ *
+ *  Returns -1 when the page has to go to a swap device instead.
+ */
+int zswap_store(struct zswap_pool *zp, struct memphy_struct *mram, addr_t fpn, addr_t *handle)
+{
+   uint64_t page[PAGING64_PAGESZ / sizeof(uint64_t)];
+   unsigned char enc[ZSWP_MAXLEN];
+   uint32_t idx;
+   int len = 0, i;
+
+   if (zp == NULL || MEMPHY_read_page(mram, fpn, (BYTE *)page) != 0)
+      return -1;
+
+   for (i = 1; i < PAGING64_PAGESZ / sizeof(uint64_t); i++)
+      if (page[i] != page[0])
+         break;
+   if (i < PAGING64_PAGESZ / sizeof(uint64_t)) {
+      len = __zrl_encode((unsigned char *)page, enc, ZSWP_MAXLEN);
+      if (len < 0) {
+         __atomic_fetch_add(&zp->nr_reject, 1, __ATOMIC_RELAXED);
+         return -1;
+      }
+   }
+
+   pthread_mutex_lock(&zp->lock);
+   if (__ent_alloc(zp, &idx) != 0) {
+      pthread_mutex_unlock(&zp->lock);
+      return -1;
+   }
+
+   struct zswap_entry *e = &zp->ent[idx];
+   if (len == 0) {
+      e->kind = ZSWP_SAME;
+      e->len = 0;
+      e->fill = page[0];
+      zp->nr_same++;
+      zp->bytes_out += sizeof(uint64_t);
+   } else {
+      long chunk = __chunk_alloc(zp, (len + ZSWP_CHUNK_SZ - 1) / ZSWP_CHUNK_SZ);
+
+      if (chunk < 0) {
+         zp->ent_free[zp->nr_ent_free++] = idx;
+         zp->nr_full++;
+         pthread_mutex_unlock(&zp->lock);
+         return -1;
+      }
+      e->kind = ZSWP_ZRL;
+      e->len = len;
+      e->chunk = chunk;
+      memcpy(zp->arena + (addr_t)chunk * ZSWP_CHUNK_SZ, enc, len);
+      zp->nr_zrl++;
+      zp->bytes_out += len;
+   }
+   zp->bytes_in += PAGING64_PAGESZ;
+   pthread_mutex_unlock(&zp->lock);
+
+   *handle = idx;
+   return 0;
+}
+
+/*
+ *  zswap_load - bring entry handle back into RAM frame fpn, the entry
+ *               is released
+ */
+int zswap_load(struct zswap_pool *zp, struct memphy_struct *mram, addr_t handle, addr_t fpn)
+{
+   uint64_t page[PAGING64_PAGESZ / sizeof(uint64_t)];
+   int i;
+
+   if (zp == NULL)
+      return -1;
+
+   pthread_mutex_lock(&zp->lock);
+   if (handle >= zp->nr_ent || zp->ent[handle].kind == ZSWP_FREE) {
+      pthread_mutex_unlock(&zp->lock);
+      printf("ERROR: zswap entry %lu is not in use\n", handle);
+      return -1;
+   }
+
+   struct zswap_entry *e = &zp->ent[handle];
+   if (e->kind == ZSWP_SAME) {
+      for (i = 0; i < PAGING64_PAGESZ / sizeof(uint64_t); i++)
+         page[i] = e->fill;
+   } else {
+      __zrl_decode((unsigned char *)zp->arena + (addr_t)e->chunk * ZSWP_CHUNK_SZ,
+                   e->len, (unsigned char *)page);
+   }
+   __ent_release(zp, handle);
+   zp->nr_load++;
+   pthread_mutex_unlock(&zp->lock);
+
+   return MEMPHY_write_page(mram, fpn, (BYTE *)page);
+}
+
+/*
+ *  zswap_invalidate - drop entry handle, its page is not wanted anymore
+ */
+int zswap_invalidate(struct zswap_pool *zp, addr_t handle)
+{
+   if (zp == NULL)
+      return -1;
+
+   pthread_mutex_lock(&zp->lock);
+   if (handle >= zp->nr_ent || zp->ent[handle].kind == ZSWP_FREE) {
+      pthread_mutex_unlock(&zp->lock);
+      return -1;
+   }
+   __ent_release(zp, handle);
+   zp->nr_drop++;
+   pthread_mutex_unlock(&zp->lock);
+
+   return 0;
+}
+
+/* zswap_print_stats - report the compression ratio and the swap
+ * device traffic the pool took over */
+void zswap_print_stats(struct zswap_pool *zp)
+{
+   unsigned long stored = zp->nr_same + zp->nr_zrl;
+
+   printf("===== ZSWAP STATISTICS =====\n");
+   printf("Pool: %u KB, peak %.1f KB used, %.1f KB in use, %u pages held\n",
+          zp->nr_chunks * ZSWP_CHUNK_SZ / 1024, zp->peak_chunks * ZSWP_CHUNK_SZ / 1024.0,
+          zp->used_chunks * ZSWP_CHUNK_SZ / 1024.0, zp->nr_ent - zp->nr_ent_free);
+   printf("Stored: %lu pages, %lu same-filled, %lu zero-run encoded\n",
+          stored, zp->nr_same, zp->nr_zrl);
+   printf("Sent to swap devices: %lu incompressible, %lu with the pool full\n",
+          zp->nr_reject, zp->nr_full);
+   if (zp->bytes_out > 0)
+      printf("Compression ratio: %.1f:1 (%lu KB -> %.1f KB)\n",
+             (double)zp->bytes_in / zp->bytes_out, zp->bytes_in / 1024, zp->bytes_out / 1024.0);
+   printf("Swap I/O avoided: %lu page writes, %lu page reads, %lu KB\n",
+          stored, zp->nr_load, (stored + zp->nr_load) * PAGING64_PAGESZ / 1024);
+   printf("Dropped on exit: %lu pages\n", zp->nr_drop);
+   printf("============================\n");
+}
+
+void zswap_free(struct zswap_pool *zp)
+{
+   if (zp == NULL)
+      return;
+   pthread_mutex_destroy(&zp->lock);
+   free(zp->arena);
+   free(zp->chunk_map);
+   free(zp->ent);
+   free(zp->ent_free);
+   free(zp);
+}
@@ -170,7 +170,7 @@ int vmap_pgd_memset(struct pcb_t *caller,           // process call
 addr_t vmap_page_range(struct pcb_t *caller,           // process call
                     addr_t addr,                       // start address which is aligned to pagesz
                     int pgnum,                      // num of mapping page
-                    struct framephy_struct *frames, // list of the mapped frames
+                    addr_t *frames,                 // the mapped frames
                     struct vm_rg_struct *ret_rg)    // return mapped region, the real mapped fp
 {                                                   // no guarantee all given pages are mapped
   printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
@@ -181,10 +181,10 @@ addr_t vmap_page_range(struct pcb_t *caller,           // process call
  * alloc_pages_range - allocate req_pgnum of frame in ram
  * @caller    : caller
  * @req_pgnum : request page num
- * @frm_lst   : frame list
+ * @frames    : obtained frames
  */
 
-addr_t alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst)
+addr_t alloc_pages_range(struct pcb_t *caller, int req_pgnum, addr_t *frames)
 {
   printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
   return 0;
@@ -229,6 +229,12 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   return 0;
 }
 
+int free_mm(struct mm_struct *mm)
+{
+  printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
+  return 0;
+}
+
 struct vm_rg_struct *init_vm_rg(addr_t rg_start, addr_t rg_end)
 {
   printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
@@ -241,7 +247,7 @@ int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct *rgnode)
   return 0;
 }
 
-int enlist_pgn_node(struct pgn_t **plist, addr_t pgn)
+int enlist_pgn_node(struct mm_struct *mm, addr_t pgn, struct pcb_t *caller)
 {
   printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
   return 0;
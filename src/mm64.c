@@ -19,21 +19,193 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
-
-/* Synchronization: Mutex for protecting Physical Memory access and Page Table expansion */
-static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+#include <time.h>
 
 #if defined(MM64)
 
+/* Page table arena statistics, summed over all mm */
+static unsigned long pgtbl_stat_tables = 0;
+static unsigned long pgtbl_stat_chunks = 0;
+static unsigned long pgtbl_stat_bytes = 0;
+static unsigned long pgtbl_stat_mms = 0;
+static unsigned long pgwalk_stat_hits = 0;
+static unsigned long pgwalk_stat_misses = 0;
+static unsigned long pgtbl_stat_huge = 0;
+static unsigned long pgtbl_stat_locks = 0;
+static unsigned long pgtbl_stat_contended = 0;
+static unsigned long pte_stat_lockless = 0;
+static unsigned long pte_stat_locked = 0;
+static unsigned long pgtbl_stat_exits = 0;
+static unsigned long pgtbl_stat_freed_tables = 0;
+static unsigned long pgtbl_stat_freed_bytes = 0;
+static unsigned long swap_stat_out = 0;
+static unsigned long swap_stat_in = 0;
+static unsigned long swap_stat_ns = 0;
+static unsigned long dzero_stat_reserved = 0;
+static unsigned long dzero_stat_reads = 0;
+static unsigned long dzero_stat_fills = 0;
+
+/*
+ * Synchronization: each mm has its own page table lock, see the lock
+ * order in os-mm.h. A failed trylock is counted as contention.
+ */
+static void pgtbl_lock(struct mm_struct *mm)
+{
+    if (pthread_mutex_trylock(&mm->pgtbl_lock) != 0) {
+        __atomic_fetch_add(&pgtbl_stat_contended, 1, __ATOMIC_RELAXED);
+        pthread_mutex_lock(&mm->pgtbl_lock);
+    }
+    __atomic_fetch_add(&pgtbl_stat_locks, 1, __ATOMIC_RELAXED);
+}
+
+static void pgtbl_unlock(struct mm_struct *mm)
+{
+    pthread_mutex_unlock(&mm->pgtbl_lock);
+}
+
 /*
- * Helper: Allocate a new page table level (array of addr_t)  
+ * pgtbl_alloc - hand out a zeroed 512-entry table from the mm arena
+ * @mm: owner of the table
+ *
+ * A new chunk is allocated when the current one is used up. The first
+ * chunk holds exactly one table per level, which covers the usual
+ * single walk of a small process, then the chunk size doubles up to
+ * PAGING64_PGTBL_CHUNK_MAX. Each chunk is zeroed once, in bulk.
+ * Must be called within the page table critical section.
  */
-static addr_t* alloc_table_level() {
-    addr_t* table = (addr_t*)malloc(sizeof(addr_t) * 512); // 9 bits = 512 entries
-    if (table) {
-        memset(table, 0, sizeof(addr_t) * 512);
+addr_t *pgtbl_alloc(struct mm_struct *mm)
+{
+    struct pgtbl_arena *arena = &mm->pgtbl;
+    struct pgtbl_chunk *chunk = arena->chunks;
+
+    if (chunk == NULL || chunk->used == chunk->ntables) {
+        int ntables = (chunk == NULL) ? PAGING64_PGTBL_LEVELS : chunk->ntables * 2;
+        if (ntables > PAGING64_PGTBL_CHUNK_MAX)
+            ntables = PAGING64_PGTBL_CHUNK_MAX;
+
+        size_t sz = ntables * PAGING64_TABLE_SZ;
+        chunk = malloc(sizeof(struct pgtbl_chunk));
+        if (chunk == NULL)
+            return NULL;
+        chunk->tables = aligned_alloc(PAGING64_TABLE_ALIGN, sz);
+        if (chunk->tables == NULL) {
+            free(chunk);
+            return NULL;
+        }
+        memset(chunk->tables, 0, sz);
+        chunk->ntables = ntables;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+
+        if (arena->chunks == NULL)
+            __atomic_fetch_add(&pgtbl_stat_mms, 1, __ATOMIC_RELAXED);
+        arena->chunks = chunk;
+        arena->nr_chunks++;
+        arena->bytes += sz;
+        __atomic_fetch_add(&pgtbl_stat_chunks, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&pgtbl_stat_bytes, sz, __ATOMIC_RELAXED);
     }
-    return table;
+
+    arena->nr_tables++;
+    __atomic_fetch_add(&pgtbl_stat_tables, 1, __ATOMIC_RELAXED);
+    return chunk->tables + (chunk->used++) * PAGING64_PTRS_PER_TABLE;
+}
+
+/*
+ * pgtbl_release - free every page table of mm in one pass over the
+ * arena chunks, the tree itself is never walked
+ */
+void pgtbl_release(struct mm_struct *mm)
+{
+    struct pgtbl_chunk *chunk = mm->pgtbl.chunks;
+
+    if (chunk != NULL) {
+        __atomic_fetch_add(&pgtbl_stat_exits, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&pgtbl_stat_freed_tables, mm->pgtbl.nr_tables, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&pgtbl_stat_freed_bytes, mm->pgtbl.bytes, __ATOMIC_RELAXED);
+    }
+
+    while (chunk != NULL) {
+        struct pgtbl_chunk *next = chunk->next;
+        free(chunk->tables);
+        free(chunk);
+        chunk = next;
+    }
+
+    mm->pgtbl.chunks = NULL;
+    mm->pgtbl.nr_tables = 0;
+    mm->pgtbl.nr_chunks = 0;
+    mm->pgtbl.bytes = 0;
+    mm->pgd = NULL;
+    pgwalk_cache_flush(mm);
+}
+
+/* swap_print_stats - report page copies between RAM and swap */
+void swap_print_stats(void)
+{
+    unsigned long pages = swap_stat_out + swap_stat_in;
+
+    printf("===== SWAP STATISTICS =====\n");
+    printf("Pages copied: %lu out, %lu in\n", swap_stat_out, swap_stat_in);
+    printf("Copy time: %lu ns", swap_stat_ns);
+    if (pages > 0 && swap_stat_ns > 0)
+        printf(", %lu ns/page, %.1f MB/s",
+               swap_stat_ns / pages,
+               (double)pages * PAGING64_PAGESZ * 1000.0 / swap_stat_ns);
+    printf("\n===========================\n");
+}
+
+/* dzero_print_stats - report the heap pages that never got a frame */
+void dzero_print_stats(void)
+{
+    printf("===== DEMAND-ZERO STATISTICS =====\n");
+    printf("Pages reserved: %lu, read faults on the zero frame: %lu, zero-filled on first touch: %lu\n",
+           dzero_stat_reserved, dzero_stat_reads, dzero_stat_fills);
+    if (dzero_stat_reserved >= dzero_stat_fills)
+        printf("Frames never allocated: %lu\n", dzero_stat_reserved - dzero_stat_fills);
+    printf("==================================\n");
+}
+
+/*
+ * pgwalk_cache_flush - forget every cached leaf table of mm,
+ * must follow any teardown of page table levels
+ */
+void pgwalk_cache_flush(struct mm_struct *mm)
+{
+    int i;
+    for (i = 0; i < PGWALK_CACHE_SZ; i++) {
+        mm->pwc.pt[i] = NULL;
+    }
+}
+
+/* pgtbl_print_stats - report page table memory over the whole run */
+void pgtbl_print_stats(void)
+{
+    printf("===== PAGE TABLE STATISTICS =====\n");
+    printf("Tables: %lu (%lu bytes each)\n",
+           pgtbl_stat_tables, (unsigned long)PAGING64_TABLE_SZ);
+    printf("Host allocations: %lu chunks, %lu bytes\n",
+           pgtbl_stat_chunks, pgtbl_stat_bytes);
+    if (pgtbl_stat_mms > 0) {
+        printf("Address spaces: %lu, avg %lu bytes/process\n",
+               pgtbl_stat_mms, pgtbl_stat_bytes / pgtbl_stat_mms);
+    }
+    printf("Torn down: %lu address spaces, %lu tables, %lu bytes\n",
+           pgtbl_stat_exits, pgtbl_stat_freed_tables, pgtbl_stat_freed_bytes);
+    printf("Live: %lu address spaces, %lu tables, %lu bytes\n",
+           pgtbl_stat_mms - pgtbl_stat_exits,
+           pgtbl_stat_tables - pgtbl_stat_freed_tables,
+           pgtbl_stat_bytes - pgtbl_stat_freed_bytes);
+    unsigned long walks = pgwalk_stat_hits + pgwalk_stat_misses;
+    printf("2MB pages mapped: %lu\n", pgtbl_stat_huge);
+    printf("Page table locks: %lu acquired, %lu contended\n",
+           pgtbl_stat_locks, pgtbl_stat_contended);
+    printf("PTE reads: %lu lockless, %lu locked\n",
+           pte_stat_lockless, pte_stat_locked);
+    printf("Walk cache: hits %lu, misses (full walks) %lu, hit rate %.2f%%\n",
+           pgwalk_stat_hits, pgwalk_stat_misses,
+           walks ? (float)pgwalk_stat_hits / walks * 100.0 : 0.0);
+    printf("=================================\n");
 }
 
 /*
@@ -106,66 +278,430 @@ int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_
 }
 
 /*
- * Helper: Traverse 5-level page table to get the pointer to the PTE.
- * If alloc=1, it creates missing levels.  
+ * Helper: Traverse the four upper levels to get the PMD table holding pgn.
+ * If alloc=1, it creates missing levels.
  * If alloc=0, it returns NULL if path is broken.
  * Warning: Must be called within a critical section if alloc=1.
  */
-static addr_t *__get_pte_ptr(struct mm_struct *mm, addr_t pgn, int alloc) {
+static addr_t *__get_pmd_table(struct mm_struct *mm, addr_t pgn, int alloc) {
     addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-    
+
     // 1. Calculate indices
     get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx);
     
     // 2. Traverse PGD (Level 5) - cấp phát nếu cần
     if (mm->pgd == NULL) {
         if (!alloc) return NULL;
-        mm->pgd = alloc_table_level();
+        __atomic_store_n(&mm->pgd, pgtbl_alloc(mm), __ATOMIC_RELEASE);
     }
     
     addr_t *p4d_table = (addr_t *)mm->pgd[pgd_idx];
     
     if (p4d_table == NULL) {
         if (!alloc) return NULL;
-        p4d_table = alloc_table_level();
-        mm->pgd[pgd_idx] = (addr_t)p4d_table;
+        p4d_table = pgtbl_alloc(mm);
+        __atomic_store_n(&mm->pgd[pgd_idx], (addr_t)p4d_table, __ATOMIC_RELEASE);
     }
 
     // 3. Traverse P4D (Level 4)
     addr_t *pud_table = (addr_t *)p4d_table[p4d_idx];
     if (pud_table == NULL) {
         if (!alloc) return NULL;
-        pud_table = alloc_table_level();
-        p4d_table[p4d_idx] = (addr_t)pud_table;
+        pud_table = pgtbl_alloc(mm);
+        __atomic_store_n(&p4d_table[p4d_idx], (addr_t)pud_table, __ATOMIC_RELEASE);
     }
 
     // 4. Traverse PUD (Level 3)
     addr_t *pmd_table = (addr_t *)pud_table[pud_idx];
     if (pmd_table == NULL) {
         if (!alloc) return NULL;
-        pmd_table = alloc_table_level();
-        pud_table[pud_idx] = (addr_t)pmd_table;
+        pmd_table = pgtbl_alloc(mm);
+        __atomic_store_n(&pud_table[pud_idx], (addr_t)pmd_table, __ATOMIC_RELEASE);
+    }
+
+    return pmd_table;
+}
+
+/*
+ * Helper: Traverse 5-level page table to get the leaf table (PT) holding pgn.
+ * Same alloc semantic as __get_pmd_table.
+ * When pgn lies in a 2MB huge page there is no leaf table: NULL is
+ * returned and *huge, if given, points to the PMD entry instead.
+ */
+static addr_t *__get_pt_table(struct mm_struct *mm, addr_t pgn, int alloc, addr_t **huge) {
+    if (huge != NULL)
+        *huge = NULL;
+
+    // 0. Page walk cache, a hit already knows the leaf table
+    addr_t tag = pgn >> PAGING64_LEVEL_BITS;
+    int slot = tag % PGWALK_CACHE_SZ;
+    if (mm->pwc.pt[slot] != NULL && mm->pwc.tag[slot] == tag) {
+        mm->pwc.hits++;
+        __atomic_fetch_add(&pgwalk_stat_hits, 1, __ATOMIC_RELAXED);
+        if (!mm->pwc.huge[slot])
+            return mm->pwc.pt[slot];
+        if (huge != NULL)
+            *huge = mm->pwc.pt[slot];
+        return NULL;
+    }
+    mm->pwc.misses++;
+    __atomic_fetch_add(&pgwalk_stat_misses, 1, __ATOMIC_RELAXED);
+
+    addr_t *pmd_table = __get_pmd_table(mm, pgn, alloc);
+    if (pmd_table == NULL)
+        return NULL;
+
+    // 5. Traverse PMD (Level 2), a leaf here maps a whole 2MB page
+    addr_t pmd_idx = tag & (PAGING64_PTRS_PER_TABLE - 1);
+    if (PAGING64_PMD_IS_HUGE(pmd_table[pmd_idx])) {
+        mm->pwc.tag[slot] = tag;
+        mm->pwc.pt[slot] = &pmd_table[pmd_idx];
+        mm->pwc.huge[slot] = 1;
+        if (huge != NULL)
+            *huge = &pmd_table[pmd_idx];
+        return NULL;
     }
 
-    // 5. Traverse PMD (Level 2)
     addr_t *pt_table = (addr_t *)pmd_table[pmd_idx];
     if (pt_table == NULL) {
         if (!alloc) return NULL;
-        pt_table = alloc_table_level();
-        pmd_table[pmd_idx] = (addr_t)pt_table;
+        pt_table = pgtbl_alloc(mm);
+        __atomic_store_n(&pmd_table[pmd_idx], (addr_t)pt_table, __ATOMIC_RELEASE);
+    }
+
+    // 6. Return Level 1 (PT)
+    mm->pwc.tag[slot] = tag;
+    mm->pwc.pt[slot] = pt_table;
+    mm->pwc.huge[slot] = 0;
+    return pt_table;
+}
+
+/*
+ * Helper: Traverse 5-level page table to get the pointer to the PTE.
+ * Same alloc semantic as __get_pt_table, *huge is set instead of
+ * returning a PTE when pgn lies in a 2MB page.
+ */
+static addr_t *__get_pte_ptr(struct mm_struct *mm, addr_t pgn, int alloc, addr_t **huge) {
+    addr_t *pt_table = __get_pt_table(mm, pgn, alloc, huge);
+    if (pt_table == NULL)
+        return NULL;
+    return &pt_table[pgn & (PAGING64_PTRS_PER_TABLE - 1)];
+}
+
+/*
+ * __huge_pte - the 4KB view of page pgn inside the 2MB page of pmde,
+ * flags are shared by the whole huge page, the FPN is offset into it
+ */
+static addr_t __huge_pte(addr_t pmde, addr_t pgn)
+{
+    addr_t pte = pmde & ~PAGING64_PMD_HUGE_MASK;
+    addr_t fpn = PAGING_FPN(pte) + (pgn & (PAGING64_HUGE_NRPAGES - 1));
+    SETVAL(pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+    return pte;
+}
+
+/*
+ * __pte_peek - lockless walk, no allocation and no walk cache
+ *
+ * Tables are only freed with the whole mm and every level is
+ * published with a release store, so acquire loads always see a
+ * complete table. Return: the entry of pgn, 0 if the path is broken
+ */
+static addr_t __pte_peek(struct mm_struct *mm, addr_t pgn)
+{
+    addr_t idx[PAGING64_PGTBL_LEVELS];
+    addr_t *table = __atomic_load_n(&mm->pgd, __ATOMIC_ACQUIRE);
+    int level;
+
+    get_pd_from_pagenum(pgn, &idx[0], &idx[1], &idx[2], &idx[3], &idx[4]);
+    for (level = 0; level < PAGING64_PGTBL_LEVELS - 1 && table != NULL; level++) {
+        addr_t entry = __atomic_load_n(&table[idx[level]], __ATOMIC_ACQUIRE);
+        if (level == PAGING64_PGTBL_LEVELS - 2 && PAGING64_PMD_IS_HUGE(entry))
+            return entry;
+        table = (addr_t *)entry;
+    }
+    if (table == NULL)
+        return 0;
+    return __atomic_load_n(&table[idx[level]], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * pte_for_each_range - visit the PTEs of pages [pgn, pgn + pgnum)
+ * @mm:    address space
+ * @alloc: 1 creates missing table levels, 0 skips the pages
+ *         of absent leaf tables without visiting them
+ * @fn:    called on each PTE, a non-zero return stops the walk.
+ *         A 2MB page is visited once, with its PMD entry and first
+ *         pgn, fn tells it apart with PAGING64_PMD_IS_HUGE
+ *
+ * Walks the tree once per leaf table, then iterates its entries.
+ * Must be called within the page table critical section.
+ * Return: the value of fn that stopped the walk, 0 otherwise
+ */
+int pte_for_each_range(struct mm_struct *mm, addr_t pgn, addr_t pgnum, int alloc,
+                       pte_range_fn fn, void *arg)
+{
+    addr_t end = pgn + pgnum;
+
+    while (pgn < end) {
+        addr_t idx = pgn & (PAGING64_PTRS_PER_TABLE - 1);
+        addr_t n = PAGING64_PTRS_PER_TABLE - idx;
+        if (n > end - pgn)
+            n = end - pgn;
+
+        addr_t *huge;
+        addr_t *pt_table = __get_pt_table(mm, pgn, alloc, &huge);
+        if (huge != NULL) {
+            int ret = fn(huge, pgn - idx, arg);
+            if (ret != 0)
+                return ret;
+        } else if (pt_table == NULL && alloc) {
+            return -1;
+        }
+        if (pt_table != NULL) {
+            for (addr_t i = 0; i < n; i++) {
+                int ret = fn(&pt_table[idx + i], pgn + i, arg);
+                if (ret != 0)
+                    return ret;
+            }
+        }
+        pgn += n;
+    }
+
+    return 0;
+}
+
+/*
+ * pte_map_range - map pages [pgn, pgn + pgnum) onto a frame array
+ * @owner:    process owning the mapping
+ * @frames:   pgnum frames, one per page, in page order
+ * @is_dirty: initial dirty bit
+ *
+ * Same PTE update as pte_set_fpn, but with one walk per leaf table
+ * and a single hold of the page table lock for the whole range.
+ * Return: number of pages mapped, -1 on error
+ */
+int pte_map_range(struct pcb_t *owner, addr_t pgn, int pgnum,
+                  addr_t *frames, int is_dirty)
+{
+    addr_t end = pgn + pgnum;
+    addr_t first = pgn;
+
+    pgtbl_lock(owner->mm);
+    while (pgn < end) {
+        addr_t idx = pgn & (PAGING64_PTRS_PER_TABLE - 1);
+        addr_t n = PAGING64_PTRS_PER_TABLE - idx;
+        if (n > end - pgn)
+            n = end - pgn;
+
+        addr_t *pt_table = __get_pt_table(owner->mm, pgn, 1, NULL);
+        if (pt_table == NULL) {
+            pgtbl_unlock(owner->mm);
+            return -1;
+        }
+
+        for (addr_t i = 0; i < n; i++) {
+            addr_t pte = pt_table[idx + i];
+            SETBIT(pte, PAGING_PTE_PRESENT_MASK);
+            CLRBIT(pte, PAGING_PTE_SWAPPED_MASK);
+            SETBIT(pte, PAGING_PTE_REFERENCED_MASK);
+            CLRBIT(pte, (PAGING_PTE_ZERO_MASK | PAGING_PTE_KSM_MASK));
+            SETVAL(pte, frames[pgn + i - first], PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+            if (is_dirty) {
+                SETBIT(pte, PAGING_PTE_DIRTY_MASK);
+            } else {
+                CLRBIT(pte, PAGING_PTE_DIRTY_MASK);
+            }
+            __atomic_store_n(&pt_table[idx + i], pte, __ATOMIC_RELEASE);
+
+            if (owner->krnl->tlb) {
+                tlb_invalidate_entry(owner->krnl->tlb, pgn + i, owner->pid);
+            }
+            MEMPHY_set_fdesc(owner->krnl->mram, frames[pgn + i - first], owner, pgn + i, FRAME_ANON);
+        }
+        pgn += n;
     }
+    pgtbl_unlock(owner->mm);
+
+    printf(">>> pte_map_range: PID=%d, pgn=%lu..%lu -> RAM, dirty=%d\n",
+           owner->pid, first, pgn - 1, is_dirty);
+    return (int)(pgn - first);
+}
 
-    // 6. Return pointer to PTE in Level 1 (PT)
-    return &pt_table[pt_idx];
+/*
+ * pte_map_huge - map the 2MB page starting at pgn onto 512 contiguous
+ * frames from fpn, with a single leaf entry at the PMD level
+ * @pgn: first page, aligned on PAGING64_HUGE_NRPAGES
+ *
+ * Fails if a leaf table already hangs from that PMD entry, the caller
+ * then falls back to 4KB pages.
+ * Return: 0 on success, -1 on error
+ */
+int pte_map_huge(struct pcb_t *owner, addr_t pgn, addr_t fpn, int is_dirty)
+{
+    if (pgn & (PAGING64_HUGE_NRPAGES - 1) || fpn & (PAGING64_HUGE_NRPAGES - 1))
+        return -1;
+
+    pgtbl_lock(owner->mm);
+    addr_t *pmd_table = __get_pmd_table(owner->mm, pgn, 1);
+    addr_t pmd_idx = PAGING64_HUGE_PGN(pgn) & (PAGING64_PTRS_PER_TABLE - 1);
+    if (pmd_table == NULL || pmd_table[pmd_idx] != 0) {
+        pgtbl_unlock(owner->mm);
+        return -1;
+    }
+
+    addr_t pmde = 0;
+    SETBIT(pmde, PAGING_PTE_PRESENT_MASK);
+    SETBIT(pmde, PAGING_PTE_REFERENCED_MASK);
+    SETBIT(pmde, PAGING_PTE_HUGE_MASK);
+    SETVAL(pmde, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+    if (is_dirty) {
+        SETBIT(pmde, PAGING_PTE_DIRTY_MASK);
+    }
+    __atomic_store_n(&pmd_table[pmd_idx], pmde | PAGING64_PMD_HUGE_MASK, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&pgtbl_stat_huge, 1, __ATOMIC_RELAXED);
+
+    /* The slot may still remember an empty walk of this prefix */
+    pgwalk_cache_flush(owner->mm);
+    if (owner->krnl->tlb) {
+        tlb_invalidate_entry(owner->krnl->tlb, pgn, owner->pid);
+    }
+    pgtbl_unlock(owner->mm);
+    for (addr_t i = 0; i < PAGING64_HUGE_NRPAGES; i++)
+        MEMPHY_set_fdesc(owner->krnl->mram, fpn + i, owner, pgn + i, FRAME_HUGE);
+
+    printf(">>> pte_map_huge: PID=%d, pgn=%lu..%lu -> RAM(fpn=%lu..%lu), dirty=%d\n",
+           owner->pid, pgn, pgn + PAGING64_HUGE_NRPAGES - 1,
+           fpn, fpn + PAGING64_HUGE_NRPAGES - 1, is_dirty);
+    return 0;
+}
+
+static int __pte_reserve_zero(addr_t *pte, addr_t pgn, void *arg)
+{
+    if (PAGING64_PMD_IS_HUGE(*pte) || PAGING_PAGE_PRESENT(*pte))
+        return 0;
+    __atomic_store_n(pte, PAGING_PTE_ZERO_MASK, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * pte_reserve_zero - reserve pages [pgn, pgn + pgnum) as demand-zero,
+ * no frame is taken until the first touch
+ */
+int pte_reserve_zero(struct pcb_t *owner, addr_t pgn, addr_t pgnum)
+{
+    pgtbl_lock(owner->mm);
+    int ret = pte_for_each_range(owner->mm, pgn, pgnum, 1, __pte_reserve_zero, NULL);
+    pgtbl_unlock(owner->mm);
+    if (ret == 0)
+        __atomic_fetch_add(&dzero_stat_reserved, pgnum, __ATOMIC_RELAXED);
+
+    printf(">>> pte_reserve_zero: PID=%d, pgn=%lu..%lu demand-zero\n",
+           owner->pid, pgn, pgn + pgnum - 1);
+    return ret;
+}
+
+/*
+ * pte_map_zero - map the shared zero frame at pgn for a read fault,
+ * the page keeps PAGING_PTE_ZERO_MASK and its first write faults again
+ */
+int pte_map_zero(struct pcb_t *owner, addr_t pgn, addr_t zero_fpn)
+{
+    pgtbl_lock(owner->mm);
+    addr_t *pte = __get_pte_ptr(owner->mm, pgn, 1, NULL);
+    if (pte == NULL) {
+        pgtbl_unlock(owner->mm);
+        return -1;
+    }
+
+    addr_t val = 0;
+    SETBIT(val, PAGING_PTE_PRESENT_MASK);
+    SETBIT(val, PAGING_PTE_REFERENCED_MASK);
+    SETBIT(val, PAGING_PTE_ZERO_MASK);
+    SETVAL(val, zero_fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+    __atomic_store_n(pte, val, __ATOMIC_RELEASE);
+    if (owner->krnl->tlb) {
+        tlb_invalidate_entry(owner->krnl->tlb, pgn, owner->pid);
+    }
+    pgtbl_unlock(owner->mm);
+    __atomic_fetch_add(&dzero_stat_reads, 1, __ATOMIC_RELAXED);
+    struct frame_desc *fd = MEMPHY_fdesc(owner->krnl->mram, zero_fpn);
+    if (fd != NULL)
+        fd->ref++;
+
+    printf(">>> pte_map_zero: PID=%d, pgn=%lu -> zero frame %lu\n",
+           owner->pid, pgn, zero_fpn);
+    return 0;
+}
+
+/* zero_fill_frame - clear frame fpn for the first touch of a page */
+int zero_fill_frame(struct memphy_struct *mram, addr_t fpn)
+{
+    static const BYTE zero[PAGING64_PAGESZ];
+
+    __atomic_fetch_add(&dzero_stat_fills, 1, __ATOMIC_RELAXED);
+    return MEMPHY_write_page(mram, fpn, zero);
+}
+
+/*
+ * __pgtbl_visit - call fn on every leaf below table
+ * @level:  5 for the PGD down to 1 for a PT
+ * @prefix: page number bits of the levels above
+ */
+static int __pgtbl_visit(addr_t *table, int level, addr_t prefix,
+                         pte_range_fn fn, void *arg)
+{
+    int i, ret;
+
+    for (i = 0; i < PAGING64_PTRS_PER_TABLE; i++) {
+        addr_t entry = table[i];
+        if (entry == 0)
+            continue;
+
+        addr_t idx = (prefix << 9) | i;
+        if (level == 1)
+            ret = fn(&table[i], idx, arg);
+        else if (level == 2 && PAGING64_PMD_IS_HUGE(entry))
+            ret = fn(&table[i], idx << 9, arg);
+        else
+            ret = __pgtbl_visit((addr_t *)entry, level - 1, idx, fn, arg);
+        if (ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/*
+ * pgtbl_teardown - hand every mapped leaf of mm to fn, then free the
+ * page tables
+ * @fn: called once per non-zero PTE and once per 2MB PMD leaf
+ *
+ * The walk follows the tree rather than the VMAs, so an empty entry
+ * skips its whole subtree at any level. The tables go back in one
+ * pgtbl_release even if fn stops the walk.
+ * Return: the value of fn that stopped the walk, 0 otherwise
+ */
+int pgtbl_teardown(struct mm_struct *mm, pte_range_fn fn, void *arg)
+{
+    int ret = 0;
+
+    pgtbl_lock(mm);
+    if (mm->pgd != NULL)
+        ret = __pgtbl_visit(mm->pgd, 5, 0, fn, arg);
+    pgtbl_release(mm);
+    pgtbl_unlock(mm);
+
+    return ret;
 }
 
 /* pte_set_swap - Set PTE entry for swapped page */
 int pte_set_swap(struct pcb_t *owner, addr_t pgn, int swptyp, addr_t swpoff) {
-    pthread_mutex_lock(&mm_lock);
+    pgtbl_lock(owner->mm);
     
-    addr_t *pte = __get_pte_ptr(owner->mm, pgn, 1);
+    addr_t *pte = __get_pte_ptr(owner->mm, pgn, 1, NULL); /* NULL on 2MB pages */
     if (pte == NULL) {
-        pthread_mutex_unlock(&mm_lock);
+        pgtbl_unlock(owner->mm);
         return -1;
     }
     
@@ -177,25 +713,30 @@ int pte_set_swap(struct pcb_t *owner, addr_t pgn, int swptyp, addr_t swpoff) {
         tlb_invalidate_entry(owner->krnl->tlb, pgn, owner->pid);
     }
     
-    SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
-    SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
-    CLRBIT(*pte, PAGING_PTE_REFERENCED_MASK);
-    CLRBIT(*pte, PAGING_PTE_DIRTY_MASK);
-    SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
-    SETVAL(*pte, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
+    /* Build the entry aside, lockless readers see one store */
+    addr_t val = *pte;
+    SETBIT(val, PAGING_PTE_PRESENT_MASK);
+    SETBIT(val, PAGING_PTE_SWAPPED_MASK);
+    CLRBIT(val, PAGING_PTE_REFERENCED_MASK);
+    CLRBIT(val, (PAGING_PTE_DIRTY_MASK | PAGING_PTE_RA_MASK));
+    SETVAL(val, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
+    SETVAL(val, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
+    __atomic_store_n(pte, val, __ATOMIC_RELEASE);
     
-    printf("New PTE value: 0x%08x (dirty=0)\n", (uint32_t)*pte);
+    printf("New PTE value: 0x%016lx (dirty=0)\n", val);
     
-    pthread_mutex_unlock(&mm_lock);
+    pgtbl_unlock(owner->mm);
+    if (swptyp < PAGING_MAX_MMSWP)
+        MEMPHY_set_fdesc(owner->krnl->mswp[swptyp], swpoff, owner, pgn, FRAME_SWAP);
     return 0;
 }
 
 /* pte_set_fpn - Set PTE entry for on-line page */
 int pte_set_fpn(struct pcb_t *owner, addr_t pgn, addr_t fpn, int is_dirty) {
-    pthread_mutex_lock(&mm_lock);
-    addr_t *pte = __get_pte_ptr(owner->mm, pgn, 1);
+    pgtbl_lock(owner->mm);
+    addr_t *pte = __get_pte_ptr(owner->mm, pgn, 1, NULL); /* NULL on 2MB pages */
     if (pte == NULL) {
-        pthread_mutex_unlock(&mm_lock);
+        pgtbl_unlock(owner->mm);
         return -1;
     }
     
@@ -210,53 +751,97 @@ int pte_set_fpn(struct pcb_t *owner, addr_t pgn, addr_t fpn, int is_dirty) {
         tlb_invalidate_entry(owner->krnl->tlb, pgn, owner->pid);
     }
     
-    SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
-    CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
-    SETBIT(*pte, PAGING_PTE_REFERENCED_MASK);
-    SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+    addr_t val = *pte;
+    SETBIT(val, PAGING_PTE_PRESENT_MASK);
+    CLRBIT(val, PAGING_PTE_SWAPPED_MASK);
+    SETBIT(val, PAGING_PTE_REFERENCED_MASK);
+    /* The frame is private to the page */
+    CLRBIT(val, (PAGING_PTE_ZERO_MASK | PAGING_PTE_KSM_MASK));
+    SETVAL(val, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
     
     if (is_dirty) {
-        SETBIT(*pte, PAGING_PTE_DIRTY_MASK);
+        SETBIT(val, PAGING_PTE_DIRTY_MASK);
     } else {
-        CLRBIT(*pte, PAGING_PTE_DIRTY_MASK);
+        CLRBIT(val, PAGING_PTE_DIRTY_MASK);
     }
+    __atomic_store_n(pte, val, __ATOMIC_RELEASE);
     
-    printf("New PTE value: 0x%08x (dirty=%d)\n", (uint32_t)*pte, is_dirty);
+    printf("New PTE value: 0x%016lx (dirty=%d)\n", val, is_dirty);
     
-    pthread_mutex_unlock(&mm_lock);
+    pgtbl_unlock(owner->mm);
+    MEMPHY_set_fdesc(owner->krnl->mram, fpn, owner, pgn, FRAME_ANON);
     return 0;
 }
 
-/* Get PTE page table entry */
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn) {
-  pthread_mutex_lock(&mm_lock);
-  addr_t *pte_ptr = __get_pte_ptr(caller->mm, pgn, 0); // Do not alloc
+/*
+ * Get PTE page table entry
+ * A present entry is returned from a lockless walk, the locked walk
+ * only runs for entries that are absent or being set up. A page with no
+ * leaf table reads as an empty entry, its present bit is clear.
+ */
+addr_t pte_get_entry(struct pcb_t *caller, addr_t pgn) {
+  addr_t entry = __pte_peek(caller->mm, pgn);
+  if (PAGING_PAGE_PRESENT(entry)) {
+      __atomic_fetch_add(&pte_stat_lockless, 1, __ATOMIC_RELAXED);
+      if (PAGING64_PMD_IS_HUGE(entry))
+          return __huge_pte(entry, pgn);
+      return entry;
+  }
+
+  __atomic_fetch_add(&pte_stat_locked, 1, __ATOMIC_RELAXED);
+  pgtbl_lock(caller->mm);
+  addr_t *huge;
+  addr_t *pte_ptr = __get_pte_ptr(caller->mm, pgn, 0, &huge); // Do not alloc
+  if (huge != NULL) {
+      addr_t pte = __huge_pte(*huge, pgn);
+      pgtbl_unlock(caller->mm);
+      return pte;
+  }
   if (pte_ptr == NULL) {
-      pthread_mutex_unlock(&mm_lock);
-      return -1; // Page not present / invalid
+      pgtbl_unlock(caller->mm);
+      return 0; // Page not present
   }
-  pthread_mutex_unlock(&mm_lock);
-  return (uint32_t)(*pte_ptr);
+  pgtbl_unlock(caller->mm);
+  return *pte_ptr;
 }
 
 /* Set PTE page table entry */
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val) {
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, addr_t pte_val) {
     // Note: This overrides the entry directly.
     
-    pthread_mutex_lock(&mm_lock);
-    addr_t *pte_ptr = __get_pte_ptr(caller->mm, pgn, 1);
-    if (pte_ptr == NULL) {
-      pthread_mutex_unlock(&mm_lock);
+    pgtbl_lock(caller->mm);
+    addr_t *huge;
+    addr_t *pte_ptr = __get_pte_ptr(caller->mm, pgn, 1, &huge);
+    if (huge != NULL) {
+        /* A 2MB page only takes the flag bits, clearing it unmaps all of it */
+        if (!PAGING_PAGE_PRESENT(pte_val)) {
+            __atomic_store_n(huge, 0, __ATOMIC_RELEASE);
+            pgwalk_cache_flush(caller->mm);
+        } else {
+            addr_t flags = PAGING_PTE_REFERENCED_MASK | PAGING_PTE_DIRTY_MASK;
+            __atomic_store_n(huge, (*huge & ~flags) | (pte_val & flags), __ATOMIC_RELEASE);
+        }
+    }
+    else if (pte_ptr == NULL) {
+      pgtbl_unlock(caller->mm);
       return -1; // Page not present / invalid
     }
     else {
-        *pte_ptr = (addr_t)pte_val;
+        __atomic_store_n(pte_ptr, pte_val, __ATOMIC_RELEASE);
     }
-    pthread_mutex_unlock(&mm_lock);
+    pgtbl_unlock(caller->mm);
     return 0;
 }
 
 
+static int __pte_reserve_one(addr_t *pte, addr_t pgn, void *arg)
+{
+    if (PAGING64_PMD_IS_HUGE(*pte))
+        return 0;
+    __atomic_store_n(pte, PAGING_PTE_RESERVED, __ATOMIC_RELEASE);
+    return 0;
+}
+
 /**
  * vmap_pgd_memset - Map a range of virtual pages into page table structure without physical allocation
  * 
@@ -308,30 +893,19 @@ int vmap_pgd_memset(struct pcb_t *caller, addr_t addr, int pgnum)
     printf(">>> vmap_pgd_memset: PID=%d, start_addr=0x%lx, start_pgn=%lu, num_pages=%d\n",
            caller->pid, addr, pgn_start, pgnum);
     
-    /* For each page in the range, ensure page table structure exists */
-    for (int i = 0; i < pgnum; i++) {
-        addr_t current_pgn = pgn_start + i;
-        
-        /* Lock to protect concurrent access to page tables */
-        pthread_mutex_lock(&mm_lock);
-        
-        /* Get PTE pointer, creating missing page table levels if needed (alloc=1) */
-        addr_t *pte_ptr = __get_pte_ptr(caller->mm, current_pgn, 1);
-        
-        if (pte_ptr == NULL) {
-            /* This should not happen if __get_pte_ptr succeeds with alloc=1 */
-            printf("ERROR vmap_pgd_memset: Failed to get/create PTE for pgn=%lu\n", current_pgn);
-            pthread_mutex_unlock(&mm_lock);
-            return -1;
-        }
-        
-        *pte_ptr = 0xFFFFFFFF;  
-        
-        printf("  Mapped pgn=%lu, set PTE to 0xFFFFFFFF at address %p\n", 
-               current_pgn, pte_ptr);
-        
-        pthread_mutex_unlock(&mm_lock);
+    /* Create the page table structure of the whole range in one pass */
+    pgtbl_lock(caller->mm);
+    int ret = pte_for_each_range(caller->mm, pgn_start, pgnum, 1,
+                                 __pte_reserve_one, NULL);
+    pgtbl_unlock(caller->mm);
+
+    if (ret != 0) {
+        printf("ERROR vmap_pgd_memset: Failed to get/create PTE range at pgn=%lu\n", pgn_start);
+        return -1;
     }
+
+    printf("  Mapped pgn=%lu..%lu, set PTE to 0x%016llx\n",
+           pgn_start, pgn_start + pgnum - 1, PAGING_PTE_RESERVED);
     
     /* Track statistics for debugging/optimization */
 #ifdef VMAP_STATISTICS
@@ -359,10 +933,9 @@ int vmap_pgd_memset(struct pcb_t *caller, addr_t addr, int pgnum)
 addr_t vmap_page_range(struct pcb_t *caller,
                     addr_t addr,
                     int pgnum,
-                    struct framephy_struct *frames,
+                    addr_t *frames,
                     struct vm_rg_struct *ret_rg)
 {
-  struct framephy_struct *fpit = frames;
   int pgit = 0;
   addr_t pgn = PAGING64_PGN(addr);
 
@@ -373,227 +946,150 @@ addr_t vmap_page_range(struct pcb_t *caller,
   ret_rg->rg_end = addr + pgnum * PAGING64_PAGESZ;
 
   /* Map range of frames to address space */
-  for (pgit = 0; pgit < pgnum; pgit++)
-  {
-      if (fpit == NULL) break; // Should not happen if alloc matches req
-
-      // Trang mới cấp phát -> dirty = 1
-      pte_set_fpn(caller, pgn + pgit, fpit->fpn, 1);
-      
-      // Tracking for FIFO replacement (enlisting)
-      enlist_pgn_node(&caller->krnl->mm->fifo_pgn, pgn + pgit, caller);
+  // Trang mới cấp phát -> dirty = 1
+  int mapped = pte_map_range(caller, pgn, pgnum, frames, 1);
+  if (mapped < 0)
+    return -1;
 
-      fpit = fpit->fp_next;
+  // Tracking for FIFO replacement (enlisting)
+  for (pgit = 0; pgit < mapped; pgit++)
+  {
+      enlist_pgn_node(caller->krnl->mm, pgn + pgit, caller);
   }
 
   return 0;
 }
 
-addr_t alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst)
+/*
+ * alloc_pages_range - allocate req_pgnum of frame in ram
+ * @caller    : caller
+ * @req_pgnum : request page num
+ * @frames    : obtained frames, room for req_pgnum
+ *
+ * The free frames above the min watermark come in one MEMPHY_get_freefp_n
+ * batch, only the shortfall goes through victim selection, one page at
+ * a time.
+ */
+addr_t alloc_pages_range(struct pcb_t *caller, int req_pgnum, addr_t *frames)
 {
   printf("ALLOC PAGE RANGE, PID: %d\n", caller->pid);
   addr_t ret_fpn;
-  struct framephy_struct *newfp_str;
-  struct framephy_struct *last_fp = NULL;
-  
-  *frm_lst = NULL;
-
-  for (addr_t pgit = 0; pgit < req_pgnum; pgit++) {
-    newfp_str = malloc(sizeof(struct framephy_struct));
-    if (!newfp_str) {
-      /* Rollback: free any already allocated frames */
-      while (*frm_lst) {
-        struct framephy_struct *temp = *frm_lst;
-        *frm_lst = (*frm_lst)->fp_next;
-        free(temp);
+  int nr_free = reclaim_free_budget(caller->krnl);
+  addr_t pgit = MEMPHY_get_freefp_n(caller->krnl->mram,
+                                    (req_pgnum < nr_free) ? req_pgnum : nr_free, frames);
+  ksm_note_alloc(caller->krnl->ksm, pgit);
+
+  for (; pgit < req_pgnum; pgit++) {
+    /* RAM is full, need to swap out a page */
+    printf("RAM is full! Need to find VICTIM for SWAP OUT in alloc_pages_range\n");
+
+    if (evict_victim_frame(caller, &ret_fpn) != 0) {
+      /* Trả lại frame RAM nếu đã lấy được */
+      if (pgit > 0) {
+        printf("  Rolling back %lu allocated frames\n", pgit);
+        MEMPHY_put_freefp_batch(caller->krnl->mram, frames, pgit);
       }
       return -1;
     }
 
-    /* Lock access to global Physical Memory Manager (MEMPHY) */
-    int res = MEMPHY_get_freefp(caller->krnl->mram, (addr_t *)&ret_fpn);
-
-    if (res == 0) {
-      /* Successfully got a free frame from RAM */
-      newfp_str->fpn = ret_fpn;
-      newfp_str->fp_next = NULL;
+    printf("Victim frame %lu now available for new page allocation\n", ret_fpn);
 
-      if (*frm_lst == NULL) {
-        *frm_lst = newfp_str;
-      } else {
-        last_fp->fp_next = newfp_str;
-      }
-      last_fp = newfp_str;
-    }
-    else {
-      /* RAM is full, need to swap out a page */
-      printf("RAM is full! Need to find VICTIM for SWAP OUT in alloc_pages_range\n");
-      
-      addr_t vicpgn, vicfpn, swpfpn;
-      uint32_t vicpte;
-      struct sc_regs regs;
-      struct pcb_t *vic_owner;
-
-      /* Find a victim page to swap out */
-      if (find_victim_page(caller->krnl->mm, &vicpgn, &vic_owner) == -1) {
-        printf("ERROR: Cannot find victim page in alloc_pages_range\n");
-
-        free(newfp_str);
-
-        if (pgit > 0) {
-            printf("  Rolling back %lu allocated frames\n", pgit);
-            while (*frm_lst) {
-              struct framephy_struct *temp = *frm_lst;
-              MEMPHY_put_freefp(caller->krnl->mram, temp->fpn);
-              *frm_lst = (*frm_lst)->fp_next;
-              free(temp);
-            }
-          }
-        
-        /* Rollback: free any already allocated frames */
-        while (*frm_lst) {
-          struct framephy_struct *temp = *frm_lst;
-          *frm_lst = (*frm_lst)->fp_next;
-          free(temp);
-        }
-        
-        return -1;
-      }
-
-      vicpte = pte_get_entry(vic_owner, vicpgn);
-      vicfpn = PAGING_FPN(vicpte);
-      int vic_is_dirty = PAGING_PTE_GET_DIRTY(vicpte);
+    frames[pgit] = ret_fpn;
+  }
 
-      printf("Selected VICTIM: PID=%d, pgn=%lu, fpn=%lu, pte=0x%08x, dirty=%d\n",
-            vic_owner->pid, vicpgn, vicfpn, vicpte, vic_is_dirty);
+  return 0;
+}
 
-      /* CHỈ SWAP OUT NẾU DIRTY */
-      if (vic_is_dirty) {
-        /* ROUND ROBIN SWAP SELECTION - với xử lý swap đầy */
-        int found_swp_id = -1;
-        for (int i = 0; i < PAGING_MAX_MMSWP; i++) {
-            int swp_idx = (caller->krnl->active_mswp_id + i) % PAGING_MAX_MMSWP;
-            
-            /* Kiểm tra thiết bị swap có tồn tại và còn slot trống không */
-            if (caller->krnl->mswp[swp_idx] != NULL && 
-                MEMPHY_get_freefp(caller->krnl->mswp[swp_idx], &swpfpn) == 0) {
-                found_swp_id = swp_idx;
-                /* Cập nhật con trỏ Round Robin cho hệ thống */
-                caller->krnl->active_mswp_id = (swp_idx + 1) % PAGING_MAX_MMSWP;
-                break;
-            }
-        }
+/*
+ * __vm_map_ram_small - map pgnum 4KB pages from mapstart, with
+ * MM_DEMAND_ZERO they are only reserved
+ */
+static addr_t __vm_map_ram_small(struct pcb_t *caller, addr_t mapstart, int pgnum, struct vm_rg_struct *ret_rg)
+{
+  if (pgnum <= 0)
+    return 0;
 
-        if (found_swp_id == -1) {
-          /* TẤT CẢ SWAP ĐỀU ĐẦY - XỬ LÝ DEADLOCK */
-          printf("ALL SWAP DEVICES ARE FULL!\n");
-          
-          /* 1. Giải phóng newfp_str đã cấp phát */
-          free(newfp_str);
-          
-          /* 2. Trả lại frame RAM nếu đã lấy được */
-          if (pgit > 0) {
-            printf("  Rolling back %lu allocated frames\n", pgit);
-            while (*frm_lst) {
-              struct framephy_struct *temp = *frm_lst;
-              MEMPHY_put_freefp(caller->krnl->mram, temp->fpn);
-              *frm_lst = (*frm_lst)->fp_next;
-              free(temp);
-            }
-          }
-
-          /* Rollback: free any already allocated frames */
-          while (*frm_lst) {
-            struct framephy_struct *temp = *frm_lst;
-            *frm_lst = (*frm_lst)->fp_next;
-            free(temp);
-          }
-          
-          printf("ERROR: Cannot allocate pages - swap full and insufficient clean pages\n");
-          return -1; 
-        }
-        
-        printf("Free SWAP frame obtained at SWAP %d: swpfpn=%lu\n", found_swp_id, swpfpn);
-
-        /* Swap Out: RAM -> SWAP được chọn */
-        printf("SWAP OUT: RAM(%lu) -> SWAP %d(%lu) because dirty=1\n", vicfpn, found_swp_id, swpfpn);
-        regs.a1 = SYSMEM_SWP_OP;
-        regs.a2 = vicfpn;
-        regs.a3 = swpfpn;
-        regs.a4 = 0;             /* Direction: 0 for Out */
-        regs.a5 = found_swp_id;  /* Swap device ID */
-        syscall(caller->krnl, caller->pid, 17, &regs);
-
-        /* Update victim PTE to point to đúng thiết bị SWAP */
-        pte_set_swap(vic_owner, vicpgn, found_swp_id, swpfpn);
-        
-        /* TLB COHERENCE: Invalidate victim TLB entry */
-        if (vic_owner->krnl->tlb) {
-            tlb_invalidate_entry(vic_owner->krnl->tlb, vicpgn, vic_owner->pid);
-            printf("  Invalidated TLB entry for swapped out victim in alloc_pages_range: VPN %lu (PID=%d)\n",
-                   vicpgn, vic_owner->pid);
-        }
-        
-        printf("Updated VICTIM PTE (PID=%d, pgn=%lu) to point to SWAP %d(%lu)\n",
-              vic_owner->pid, vicpgn, found_swp_id, swpfpn);
-      } else {
-        printf("VICTIM is CLEAN (dirty=0), no need to write to SWAP\n");
-        /* Chỉ cần invalidate PTE của victim */
-        pte_set_entry(vic_owner, vicpgn, 0);
-        
-        /* TLB COHERENCE: Invalidate clean victim TLB entry */
-        if (vic_owner->krnl->tlb) {
-            tlb_invalidate_entry(vic_owner->krnl->tlb, vicpgn, vic_owner->pid);
-            printf("  Invalidated TLB entry for clean victim in alloc_pages_range: VPN %lu (PID=%d)\n",
-                   vicpgn, vic_owner->pid);
-        }
-        
-        printf("Invalidated VICTIM PTE (PID=%d, pgn=%lu)\n",
-              vic_owner->pid, vicpgn);
-      }
+#ifdef MM_DEMAND_ZERO
+  /* Reserve only, the pages fault in on their first touch */
+  ret_rg->rg_start = mapstart;
+  ret_rg->rg_end = mapstart + pgnum * PAGING64_PAGESZ;
+  return (pte_reserve_zero(caller, mapstart >> PAGING64_ADDR_PT_LOBIT, pgnum) == 0) ? 0 : -1;
+#else
+  addr_t fbuf[64]; /* usual small growth, no heap traffic */
+  addr_t *frames = fbuf;
+  addr_t ret_alloc = 0;
 
-      /* Now we can use the victim's frame for the new page */
-      ret_fpn = vicfpn;
-      printf("Victim frame %lu now available for new page allocation\n", ret_fpn);
+  if (pgnum > 64) {
+    frames = malloc(pgnum * sizeof(addr_t));
+    if (frames == NULL)
+      return -1;
+  }
 
-      newfp_str->fpn = ret_fpn;
-      newfp_str->fp_next = NULL;
+  ret_alloc = alloc_pages_range(caller, pgnum, frames);
 
-      if (*frm_lst == NULL) {
-        *frm_lst = newfp_str;
-      } else {
-        last_fp->fp_next = newfp_str;
-      }
-      last_fp = newfp_str;
-    }
-  }
+  if (ret_alloc == -3000)
+    printf("Out of memory\n");
+  if (ret_alloc == 0)
+    vmap_page_range(caller, mapstart, pgnum, frames, ret_rg);
 
-  return 0;
+  if (frames != fbuf)
+    free(frames);
+  return (ret_alloc == 0) ? 0 : -1;
+#endif
 }
 
 /*
  * vm_map_ram - do the mapping all vm are to ram storage device
+ *
+ * With MM_HUGEPAGE, every 2MB aligned block fully inside the range is
+ * backed by one huge page when RAM has 512 aligned contiguous free
+ * frames, the rest is mapped with 4KB pages. Huge pages do not enter
+ * the FIFO list, they stay resident until the process exits.
+ *
+ * MM_DEMAND_ZERO leaves the huge blocks eager: a huge page has no 4KB
+ * PTEs to carry the zero bit, and reserving the block 4KB at a time
+ * would hang a leaf table under its PMD entry and rule out the huge
+ * mapping for good. Only the head, the tail and the blocks that fall
+ * back to 4KB pages are reserved.
  */
 addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend, addr_t mapstart, int incpgnum, struct vm_rg_struct *ret_rg)
 {
-  struct framephy_struct *frm_lst = NULL;
-  addr_t ret_alloc = 0;
-  int pgnum = incpgnum;
+#ifdef MM_HUGEPAGE
+  addr_t pgn = mapstart >> PAGING64_ADDR_PT_LOBIT;
+  addr_t end = pgn + incpgnum;
+  addr_t hpgn = (pgn + PAGING64_HUGE_NRPAGES - 1) & ~(addr_t)(PAGING64_HUGE_NRPAGES - 1);
+  addr_t hend = end & ~(addr_t)(PAGING64_HUGE_NRPAGES - 1);
+
+  if (hpgn < hend) {
+    /* Head, aligned huge blocks, tail */
+    if (__vm_map_ram_small(caller, mapstart, hpgn - pgn, ret_rg) < 0)
+      return -1;
 
-  ret_alloc = alloc_pages_range(caller, pgnum, &frm_lst);
+    for (; hpgn < hend; hpgn += PAGING64_HUGE_NRPAGES) {
+      addr_t fpn;
+      addr_t hstart = hpgn << PAGING64_ADDR_PT_LOBIT;
 
-  if (ret_alloc < 0 && ret_alloc != -3000)
-    return -1;
+      if (MEMPHY_get_freefp_range(caller->krnl->mram, PAGING64_HUGE_NRPAGES,
+                                  PAGING64_HUGE_NRPAGES, &fpn) == 0) {
+        if (pte_map_huge(caller, hpgn, fpn, 1) == 0)
+          continue;
+        MEMPHY_put_freefp_range(caller->krnl->mram, fpn, PAGING64_HUGE_NRPAGES);
+      }
+      printf("No 2MB page for pgn=%lu, fall back to 4KB pages\n", hpgn);
+      if (__vm_map_ram_small(caller, hstart, PAGING64_HUGE_NRPAGES, ret_rg) < 0)
+        return -1;
+    }
 
-  if (ret_alloc == -3000)
-  {
-    printf("Out of memory\n");
-    return -1; // Out of Memory
-  }
+    if (__vm_map_ram_small(caller, hend << PAGING64_ADDR_PT_LOBIT, end - hend, ret_rg) < 0)
+      return -1;
 
-  vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
+    ret_rg->rg_start = mapstart;
+    ret_rg->rg_end = mapstart + incpgnum * PAGING64_PAGESZ;
+    return 0;
+  }
+#endif
 
-  return 0;
+  return __vm_map_ram_small(caller, mapstart, incpgnum, ret_rg);
 }
 
 /* Swap copy content page from source frame to destination frame */
@@ -616,18 +1112,19 @@ int __swap_cp_page(struct memphy_struct *mpsrc, addr_t srcfpn,
            (mpdst == caller->krnl->mram) ? "RAM" : "SWAP");
   }
   
-  addr_t cellidx;
-  addr_t addrsrc, addrdst;
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  int ret = MEMPHY_copy_page(mpsrc, srcfpn, mpdst, dstfpn);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
 
-  for (cellidx = 0; cellidx < PAGING64_PAGESZ; cellidx++)
-  {
-    addrsrc = srcfpn * PAGING64_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING64_PAGESZ + cellidx;
-
-    BYTE data;
-    MEMPHY_read(mpsrc, addrsrc, &data);
-    MEMPHY_write(mpdst, addrdst, data);
+  if (ret != 0) {
+    printf("ERROR: swap copy out of the device bounds\n");
+    return -1;
   }
+  __atomic_fetch_add(is_swap_in ? &swap_stat_in : &swap_stat_out, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&swap_stat_ns,
+                     (t1.tv_sec - t0.tv_sec) * 1000000000UL + t1.tv_nsec - t0.tv_nsec,
+                     __ATOMIC_RELAXED);
 
   printf("Swap completed successfully\n");
   printf("=== End SWAP ===\n\n");
@@ -648,6 +1145,9 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   mm->pud = NULL;
   mm->pmd = NULL;
   mm->pt  = NULL;
+  pthread_mutex_init(&mm->pgtbl_lock, NULL);
+  memset(&mm->pgtbl, 0, sizeof(struct pgtbl_arena));
+  memset(&mm->pwc, 0, sizeof(struct pgwalk_cache));
 
   /* By default the owner comes with at least one vma */
   vma0->vm_id = 0;
@@ -655,9 +1155,6 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma0->vm_end = vma0->vm_start;
   vma0->sbrk = vma0->vm_start;
 
-  struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
-  enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
-
   vma0->vm_freerg_list = NULL;
   vma0->vm_next = NULL;
   vma0->vm_mm = mm;
@@ -665,10 +1162,48 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   mm->mmap = vma0;
   mm->fifo_pgn = NULL;
   mm->clock_hand = NULL;
+  mm->ksm_hand = NULL;
+  mm->pgn_hash = NULL;
+  mm->pgn_hash_sz = 0;
+  mm->nr_pgn = 0;
+  mm->own_pgn = NULL;
+  mm->swpc_id = -1;
+  mm->swpc_next = 0;
+  mm->swpc_left = 0;
   
   return 0;
 }
 
+/*
+ * free_mm - release what init_mm and the VM area code allocated
+ * @mm: an address space whose frames and tables are already gone
+ *      (see free_pcb_memph), mm itself is freed too
+ */
+int free_mm(struct mm_struct *mm)
+{
+  struct vm_area_struct *vma = mm->mmap;
+
+  while (vma != NULL) {
+    struct vm_area_struct *vnext = vma->vm_next;
+    struct vm_rg_struct *rg = vma->vm_freerg_list;
+
+    while (rg != NULL) {
+      struct vm_rg_struct *rgnext = rg->rg_next;
+      free(rg);
+      rg = rgnext;
+    }
+    free(vma);
+    vma = vnext;
+  }
+
+  pgtbl_release(mm);
+  pthread_mutex_destroy(&mm->pgtbl_lock);
+  free(mm->pgn_hash);
+  free(mm);
+
+  return 0;
+}
+
 struct vm_rg_struct *init_vm_rg(addr_t rg_start, addr_t rg_end)
 {
   struct vm_rg_struct *rgnode = malloc(sizeof(struct vm_rg_struct));
@@ -688,7 +1223,87 @@ int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct *rgnode)
   return 0;
 }
 
-int enlist_pgn_node(struct pgn_t **plist, addr_t pgn, struct pcb_t *caller)
+/* Bucket of page pgn of owner in the CLOCK index */
+static int pgn_hash_idx(struct mm_struct *mm, struct pcb_t *owner, addr_t pgn)
+{
+    uint64_t h = (pgn ^ ((uint64_t)owner->pid << 40)) * 0x9e3779b97f4a7c15ULL;
+    return (int)(h >> 32) & (mm->pgn_hash_sz - 1);
+}
+
+/*
+ * pgn_hash_init - size the CLOCK index to the RAM frames, every node is
+ * a resident page so the chains stay short
+ */
+static int pgn_hash_init(struct mm_struct *mm, struct pcb_t *caller)
+{
+    int sz = 64;
+    addr_t nr_frames = caller->krnl->mram->maxsz / PAGING64_PAGESZ;
+
+    while (sz < nr_frames && sz < (1 << 24))
+        sz <<= 1;
+    mm->pgn_hash = calloc(sz, sizeof(struct pgn_t *));
+    if (mm->pgn_hash == NULL)
+        return -1;
+    mm->pgn_hash_sz = sz;
+    return 0;
+}
+
+/*
+ * lookup_pgn_node - the CLOCK node of page pgn of owner
+ * Return: the node, NULL when the page is not on the list
+ */
+struct pgn_t *lookup_pgn_node(struct mm_struct *mm, struct pcb_t *owner, addr_t pgn)
+{
+    struct pgn_t *node;
+
+    if (mm->pgn_hash == NULL)
+        return NULL;
+    for (node = mm->pgn_hash[pgn_hash_idx(mm, owner, pgn)]; node != NULL; node = node->pg_hnext)
+        if (node->owner == owner && node->pgn == pgn)
+            return node;
+    return NULL;
+}
+
+/*
+ * pte_get_ptr - the leaf entry of page pgn, NULL when it is absent or
+ * part of a 2MB page. The pointer stays valid until the mm is freed.
+ */
+static addr_t *pte_get_ptr(struct pcb_t *caller, addr_t pgn)
+{
+    addr_t *huge, *pte;
+
+    pgtbl_lock(caller->mm);
+    pte = __get_pte_ptr(caller->mm, pgn, 0, &huge);
+    pgtbl_unlock(caller->mm);
+    return pte;
+}
+
+/* pgn_node_pte - current PTE of a CLOCK node, no walk when it is cached */
+addr_t pgn_node_pte(struct pgn_t *node)
+{
+    if (node->pte != NULL)
+        return __atomic_load_n(node->pte, __ATOMIC_ACQUIRE);
+    return pte_get_entry(node->owner, node->pgn);
+}
+
+/*
+ * pgn_node_clear_bits - clear flag bits in the PTE of a CLOCK node,
+ * the reference bit for a second chance, the dirty bit after writeback
+ */
+void pgn_node_clear_bits(struct pgn_t *node, addr_t mask)
+{
+    if (node->pte != NULL) {
+        __atomic_fetch_and(node->pte, ~mask, __ATOMIC_RELEASE);
+    } else {
+        addr_t pte = pte_get_entry(node->owner, node->pgn);
+        if (!PAGING_PAGE_PRESENT(pte))
+            return;
+        CLRBIT(pte, mask);
+        pte_set_entry(node->owner, node->pgn, pte);
+    }
+}
+
+int enlist_pgn_node(struct mm_struct *mm, addr_t pgn, struct pcb_t *caller)
 {
     /* Kiểm tra đầu vào hợp lệ */
     if (caller == NULL || caller->pid <= 0) {
@@ -702,25 +1317,20 @@ int enlist_pgn_node(struct pgn_t **plist, addr_t pgn, struct pcb_t *caller)
         return -1;
     }
     
-    /* KIỂM TRA TRÙNG LẶP: Đảm bảo page này chưa có trong danh sách */
-    struct pgn_t *existing = *plist;
-    while (existing != NULL) {
-        if (existing->owner == caller && existing->pgn == pgn) {
-            printf("WARNING: Page %lu (PID=%d) already exists in FIFO list, skipping\n", 
-                   pgn, caller->pid);
-            return 0; // Không thêm trùng, nhưng không phải lỗi
-        }
-        existing = existing->pg_next;
+    if (mm->pgn_hash == NULL && pgn_hash_init(mm, caller) != 0) {
+        printf("ERROR: malloc failed in enlist_pgn_node\n");
+        return -1;
     }
-    
-    /* Kiểm tra PTE để đảm bảo page thực sự tồn tại và hợp lệ */
-    uint32_t pte = pte_get_entry(caller, pgn);
-    if (pte == (uint32_t)-1) {
-        printf("WARNING: Cannot get PTE for pgn=%lu (PID=%d), page may not exist\n", 
+
+    /* KIỂM TRA TRÙNG LẶP: Đảm bảo page này chưa có trong danh sách */
+    if (lookup_pgn_node(mm, caller, pgn) != NULL) {
+        printf("WARNING: Page %lu (PID=%d) already exists in FIFO list, skipping\n", 
                pgn, caller->pid);
-        return -1;
+        return 0; // Không thêm trùng, nhưng không phải lỗi
     }
     
+    /* Kiểm tra PTE để đảm bảo page thực sự tồn tại và hợp lệ */
+    addr_t pte = pte_get_entry(caller, pgn);
     if (!PAGING_PTE_GET_PRESENT(pte)) {
         printf("WARNING: Page %lu (PID=%d) is not present, not adding to FIFO\n", 
                pgn, caller->pid);
@@ -743,25 +1353,76 @@ int enlist_pgn_node(struct pgn_t **plist, addr_t pgn, struct pcb_t *caller)
     
     pnode->pgn = pgn;
     pnode->owner = caller;
-    pnode->pg_next = NULL;
+    pnode->pte = pte_get_ptr(caller, pgn);
+    int b = pgn_hash_idx(mm, caller, pgn);
+    pnode->pg_hnext = mm->pgn_hash[b];
+    mm->pgn_hash[b] = pnode;
+    pnode->pg_oprev = NULL;
+    pnode->pg_onext = caller->mm->own_pgn;
+    if (pnode->pg_onext != NULL)
+        pnode->pg_onext->pg_oprev = pnode;
+    caller->mm->own_pgn = pnode;
     
-    /* Thêm vào CUỐI danh sách (FIFO đúng nghĩa) */
-    if (*plist == NULL) {
-        *plist = pnode;
+    /* Thêm vào CUỐI danh sách (FIFO đúng nghĩa), tức là ngay trước đầu */
+    if (mm->fifo_pgn == NULL) {
+        pnode->pg_next = pnode->pg_prev = pnode;
+        mm->fifo_pgn = pnode;
     } else {
-        struct pgn_t *last = *plist;
-        while (last->pg_next != NULL) {
-            last = last->pg_next;
-        }
+        struct pgn_t *last = mm->fifo_pgn->pg_prev;
+        pnode->pg_prev = last;
+        pnode->pg_next = mm->fifo_pgn;
         last->pg_next = pnode;
+        mm->fifo_pgn->pg_prev = pnode;
     }
+    mm->nr_pgn++;
     
-    printf("===== Added to FIFO: pgn=%lu (PID=%d) =====\n", pgn, caller->pid);
-    print_list_pgn(*plist);
+    printf("===== Added to FIFO: pgn=%lu (PID=%d), %d pages =====\n",
+           pgn, caller->pid, mm->nr_pgn);
     
     return 0;
 }
 
+/*
+ * delist_pgn_node - unlink and free a CLOCK node, from the owner's list too
+ *
+ * The hands move on to the next node, the list head too when it is the
+ * oldest page that goes.
+ */
+void delist_pgn_node(struct mm_struct *mm, struct pgn_t *node)
+{
+    struct pgn_t **pp;
+
+    for (pp = &mm->pgn_hash[pgn_hash_idx(mm, node->owner, node->pgn)];
+         *pp != node; pp = &(*pp)->pg_hnext)
+        ;
+    *pp = node->pg_hnext;
+
+    if (node->pg_oprev != NULL)
+        node->pg_oprev->pg_onext = node->pg_onext;
+    else
+        node->owner->mm->own_pgn = node->pg_onext;
+    if (node->pg_onext != NULL)
+        node->pg_onext->pg_oprev = node->pg_oprev;
+
+    if (node->pg_next == node) {
+        mm->fifo_pgn = NULL;
+        mm->clock_hand = NULL;
+        mm->ksm_hand = NULL;
+    } else {
+        /* The KSM pass ends at the tail, the hand does not wrap */
+        if (mm->ksm_hand == node)
+            mm->ksm_hand = (node->pg_next == mm->fifo_pgn) ? NULL : node->pg_next;
+        node->pg_prev->pg_next = node->pg_next;
+        node->pg_next->pg_prev = node->pg_prev;
+        if (mm->fifo_pgn == node)
+            mm->fifo_pgn = node->pg_next;
+        if (mm->clock_hand == node)
+            mm->clock_hand = node->pg_next;
+    }
+    mm->nr_pgn--;
+    free(node);
+}
+
 int print_list_fp(struct framephy_struct *ifp)
 {
   struct framephy_struct *fp = ifp;
@@ -826,12 +1487,12 @@ int print_list_pgn(struct pgn_t *ip)
 
   struct pgn_t *curr = ip;
   int count = 0;
-  while (curr != NULL)
+  do
   {
     printf("  va[%ld] (PID=%d)\n", curr->pgn, curr->owner->pid);
     curr = curr->pg_next;
     count++;
-  }
+  } while (curr != ip);
   printf("Total: %d pages\n", count);
   printf("\n");
 
@@ -848,16 +1509,26 @@ void print_pgtbl_recursive(addr_t *table, int level, addr_t current_prefix) {
         if (table[i] == 0) continue;
 
         if (level == 1) { // PT Level, table[i] is PTE 
-            printf("  %05lx: [%08x] (FPN: %ld) (PRE: %d) (SWA: %d) (DIR: %d) (REF: %d)\n",
+            printf("  %05lx: [%016lx] (FPN: %lu) (PRE: %d) (SWA: %d) (DIR: %d) (REF: %d)\n",
                     (current_prefix << 9) | i,
-                    (uint32_t)table[i],
-                    PAGING_FPN(table[i]),
+                    table[i],
+                    (addr_t)PAGING_FPN(table[i]),
                     PAGING_PTE_GET_PRESENT(table[i]),
                     PAGING_PTE_GET_SWAPPED(table[i]),
                     PAGING_PTE_GET_DIRTY(table[i]) ? 1 : 0,
                     PAGING_PTE_GET_REFERENCED(table[i]) ? 1 : 0);
             
             ++count;
+        } else if (level == 2 && PAGING64_PMD_IS_HUGE(table[i])) {
+            // PMD leaf, one 2MB page
+            printf("  %05lx: [%016lx] (FPN: %lu) (PRE: %d) (SWA: %d) (DIR: %d) (REF: %d) (HUGE: 2MB)\n",
+                    ((current_prefix << 9) | i) << 9,
+                    table[i],
+                    (addr_t)PAGING_FPN(table[i]),
+                    PAGING_PTE_GET_PRESENT(table[i]),
+                    PAGING_PTE_GET_SWAPPED(table[i]),
+                    PAGING_PTE_GET_DIRTY(table[i]) ? 1 : 0,
+                    PAGING_PTE_GET_REFERENCED(table[i]) ? 1 : 0);
         } else {
             // Intermediate levels, table[i] is pointer to next table
             print_pgtbl_recursive((addr_t *)table[i], level - 1, (current_prefix << 9) | i);
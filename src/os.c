@@ -4,7 +4,9 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "mm64.h"
 #include <unistd.h>
+#include <sys/resource.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
@@ -16,8 +18,11 @@ static int done = 0;
 static struct krnl_t os;
 
 #ifdef MM_PAGING
-static int memramsz;
-static int memswpsz[PAGING_MAX_MMSWP];
+static addr_t memramsz;
+static struct memphy_bank rambank[MEMPHY_MAX_NODES];
+static int nr_rambank;
+static addr_t memswpsz[PAGING_MAX_MMSWP];
+static char * memswpfile[PAGING_MAX_MMSWP]; /* host file backing, or NULL */
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
@@ -30,15 +35,77 @@ struct mmpaging_ld_args {
 };
 #endif
 
-static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
+/* A pending arrival read from the configure file */
+struct ld_proc_t {
+	unsigned long start_time;
 #ifdef MLQ_SCHED
-	unsigned long * prio;
+	unsigned long prio;
 #endif
+	unsigned long seq;	/* Config order, keeps equal arrivals stable */
+	char * path;
+};
+
+/* Arrivals are kept in a binary min-heap ordered by (start_time, seq) */
+static struct ld_args{
+	struct ld_proc_t * heap;
+	int size;
+	int capacity;
 } ld_processes;
 int num_processes;
 
+static int ld_before(struct ld_proc_t * a, struct ld_proc_t * b) {
+	if (a->start_time != b->start_time)
+		return a->start_time < b->start_time;
+	return a->seq < b->seq;
+}
+
+static void ld_push(struct ld_proc_t * item) {
+	if (ld_processes.size == ld_processes.capacity) {
+		ld_processes.capacity = ld_processes.capacity ?
+			ld_processes.capacity * 2 : 64;
+		ld_processes.heap = realloc(ld_processes.heap,
+			sizeof(struct ld_proc_t) * ld_processes.capacity);
+		if (ld_processes.heap == NULL) {
+			printf("Cannot allocate arrival queue\n");
+			exit(1);
+		}
+	}
+
+	/* Sift up, a config that is already sorted stops immediately */
+	int i = ld_processes.size++;
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!ld_before(item, &ld_processes.heap[parent]))
+			break;
+		ld_processes.heap[i] = ld_processes.heap[parent];
+		i = parent;
+	}
+	ld_processes.heap[i] = *item;
+}
+
+static struct ld_proc_t ld_pop(void) {
+	struct ld_proc_t top = ld_processes.heap[0];
+	struct ld_proc_t last = ld_processes.heap[--ld_processes.size];
+	int i = 0;
+
+	/* Sift the last element down from the root */
+	while (1) {
+		int child = 2 * i + 1;
+		if (child >= ld_processes.size)
+			break;
+		if (child + 1 < ld_processes.size &&
+		    ld_before(&ld_processes.heap[child + 1], &ld_processes.heap[child]))
+			child++;
+		if (!ld_before(&ld_processes.heap[child], &last))
+			break;
+		ld_processes.heap[i] = ld_processes.heap[child];
+		i = child;
+	}
+	if (ld_processes.size > 0)
+		ld_processes.heap[i] = last;
+	return top;
+}
+
 struct cpu_args {
 	struct timer_id_t * timer_id;
 	int id;
@@ -48,6 +115,9 @@ struct cpu_args {
 static void * cpu_routine(void * args) {
 	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
 	int id = ((struct cpu_args*)args)->id;
+#ifdef MM_PAGING
+	MEMPHY_set_cpu(id); /* frame allocations go through this CPU's magazines */
+#endif
 	/* Check for new process in ready queue */
 	int time_left = 0;
 	struct pcb_t * proc = NULL;
@@ -70,7 +140,8 @@ static void * cpu_routine(void * args) {
 			/* The porcess has finish it job */
 			printf("\tCPU %d: Processed %2d has finished\n",
 				id ,proc->pid);
-			free(proc);
+			finish_proc(proc);
+			unload(proc);
 			proc = get_proc();
 			time_left = 0;
 		}else if (time_left == 0) {
@@ -115,46 +186,159 @@ static void * ld_routine(void * args) {
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-	int i = 0;
 	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
+	while (ld_processes.size > 0) {
+		struct ld_proc_t next = ld_pop();
+		struct pcb_t * proc = load(next.path);
 		struct krnl_t * krnl = proc->krnl = &os;	
 
 #ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
+		proc->prio = next.prio;
 #endif
-		while (current_time() < ld_processes.start_time[i]) {
+		while (current_time() < next.start_time) {
 			next_slot(timer_id);
 		}
-		usleep(1000);
 #ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
-		init_mm(proc->mm, proc);
 		krnl->mram = mram;
 		krnl->mswp = mswp;
 		krnl->active_mswp_id = ld_ptr->active_mswp_id;
 #endif
 		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+			next.path, proc->pid, next.prio);
 		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
+		free(next.path);
 
 		// Thêm cái này
-		if (i == num_processes || ld_processes.start_time[i] > current_time()) {
+		if (ld_processes.size == 0 ||
+		    ld_processes.heap[0].start_time > current_time()) {
 			next_slot(timer_id);
 		}
 		//
 		//next_slot(timer_id); Xóa cái này
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
+	free(ld_processes.heap);
 	done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+#if defined(MM_PAGING) && defined(MM_KSM)
+static int ksmd_stop = 0;
+
+/*
+ * ksmd_routine - same-page merging in the background, one batch per
+ * time slot until the CPUs stop
+ *
+ * ksmd is a timer device like the CPUs, so how much it scans depends on
+ * the slots that went by and not on the host clock.
+ */
+static void * ksmd_routine(void * args) {
+	struct timer_id_t * timer_id = (struct timer_id_t *)args;
+
+	while (!__atomic_load_n(&ksmd_stop, __ATOMIC_ACQUIRE)) {
+		libksm_scan(&os, KSM_SCAN_BATCH);
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	return NULL;
+}
+#endif
+
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+static int kswapd_stop = 0;
+
+/*
+ * kswapd_routine - background page reclaim, once per time slot
+ *
+ * kswapd is a timer device like the CPUs, it keeps the timer going until
+ * the CPUs are done and main stops it.
+ */
+static void * kswapd_routine(void * args) {
+	struct timer_id_t * timer_id = (struct timer_id_t *)args;
+
+	while (!__atomic_load_n(&kswapd_stop, __ATOMIC_ACQUIRE)) {
+		libkswapd_reclaim(&os);
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	return NULL;
+}
+#endif
+
+#if defined(MM_PAGING) && defined(MM_WRITEBACK)
+static int wbd_stop = 0;
+
+/* wbd_routine - dirty page writeback, once per time slot like kswapd */
+static void * wbd_routine(void * args) {
+	struct timer_id_t * timer_id = (struct timer_id_t *)args;
+
+	while (!__atomic_load_n(&wbd_stop, __ATOMIC_ACQUIRE)) {
+		libwriteback_scan(&os);
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	return NULL;
+}
+#endif
+
+#if defined(MM_PAGING) && !defined(MM_FIXED_MEMSZ)
+/*
+ * parse_memsz - size of RAM or of a swap device in the configure file
+ * @tok:  SIZE[K|M|G][:FILE], e.g. 16777216 or 32G:swap0.img
+ * @path: set to a copy of FILE for a file-backed device, NULL otherwise.
+ *        A relative FILE lands in the directory os is run from.
+ */
+static addr_t parse_memsz(const char * tok, char ** path) {
+	char * end;
+	addr_t sz = strtoull(tok, &end, 10);
+
+	switch (*end) {
+	case 'G': case 'g': sz <<= 10; /* fall through */
+	case 'M': case 'm': sz <<= 10; /* fall through */
+	case 'K': case 'k': sz <<= 10; end++;
+	}
+	*path = (*end == ':' && end[1] != '\0') ? strdup(end + 1) : NULL;
+	return sz;
+}
+
+/*
+ * parse_rambanks - RAM made of NUMA banks
+ * @tok: BANK[,BANK...], BANK = SIZE[K|M|G][@CPU[-CPU]][:NS], e.g.
+ *       4M@0-1:80,4M@2-3:140. NS is the local access cost, a bank
+ *       without CPUs is local to none.
+ */
+static void parse_rambanks(char * tok) {
+	char * save = NULL;
+	char * b;
+
+	nr_rambank = 0;
+	memramsz = 0;
+	for (b = strtok_r(tok, ",", &save); b != NULL && nr_rambank < MEMPHY_MAX_NODES;
+	     b = strtok_r(NULL, ",", &save)) {
+		struct memphy_bank * bk = &rambank[nr_rambank++];
+		char * end;
+
+		bk->size = strtoull(b, &end, 10);
+		switch (*end) {
+		case 'G': case 'g': bk->size <<= 10; /* fall through */
+		case 'M': case 'm': bk->size <<= 10; /* fall through */
+		case 'K': case 'k': bk->size <<= 10; end++;
+		}
+		bk->cpu_first = 0;
+		bk->cpu_last = -1;
+		if (*end == '@') {
+			bk->cpu_first = bk->cpu_last = strtol(end + 1, &end, 10);
+			if (*end == '-')
+				bk->cpu_last = strtol(end + 1, &end, 10);
+		}
+		bk->access_ns = (*end == ':') ? strtoul(end + 1, &end, 10) : 0;
+		memramsz += bk->size;
+	}
+	if (b != NULL)
+		printf("RAM has more than %d banks, the rest ignored\n", MEMPHY_MAX_NODES);
+}
+#endif
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
@@ -162,9 +346,6 @@ static void read_config(const char * path) {
 		exit(1);
 	}
 	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
 #ifdef MM_PAGING
 	int sit;
 #ifdef MM_FIXED_MEMSZ
@@ -182,58 +363,62 @@ static void read_config(const char * path) {
 	 * Format: (size=0 result non-used memswap, must have RAM and at least 1 SWAP)
 	 *        MEM_RAM_SZ MEM_SWP0_SZ MEM_SWP1_SZ MEM_SWP2_SZ MEM_SWP3_SZ
 	*/
-	fscanf(file, "%d\n", &memramsz);
-	printf("RAM size: %d \n", memramsz);
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-		fscanf(file, "%d", &(memswpsz[sit])); 
+	char * tok = NULL;
+	char * ramfile = NULL;
+	if (fscanf(file, "%ms", &tok) == 1) {
+		if (strpbrk(tok, ",@") != NULL)
+			parse_rambanks(tok);
+		else
+			memramsz = parse_memsz(tok, &ramfile);
+		free(tok);
+	}
+	if (ramfile != NULL) {
+		printf("RAM cannot be file-backed, %s ignored\n", ramfile);
+		free(ramfile);
+	}
+	printf("RAM size: %lu \n", memramsz);
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+		tok = NULL;
+		if (fscanf(file, "%ms", &tok) != 1)
+			break;
+		memswpsz[sit] = parse_memsz(tok, &memswpfile[sit]);
+		free(tok);
+	}
 
        fscanf(file, "\n"); /* Final character */
 #endif
 #endif
 
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#endif
+	/* Stream the process lines straight into the arrival heap,
+	 * each path is sized to its own name */
+	struct ld_proc_t item;
+	char * proc;
 	int i;
 	for (i = 0; i < num_processes; i++) {
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
 #ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
+		if (fscanf(file, "%lu %ms %lu\n", &item.start_time, &proc, &item.prio) != 3)
+			break;
+		if (item.prio >= MAX_PRIO) {
+			printf("Process %s has prio %lu, clamped to %d\n",
+				proc, item.prio, MAX_PRIO - 1);
+			item.prio = MAX_PRIO - 1;
+		}
 #else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
+		if (fscanf(file, "%lu %ms\n", &item.start_time, &proc) != 2)
+			break;
 #endif
-		strcat(ld_processes.path[i], proc);
+		item.seq = i;
+		item.path = malloc(strlen("input/proc/") + strlen(proc) + 1);
+		strcpy(item.path, "input/proc/");
+		strcat(item.path, proc);
+		free(proc);
+		ld_push(&item);
 	}
-	
-	//Thêm cái này
-    for (int k = 0; k < num_processes - 1; k++) {
-        for (int j = k + 1; j < num_processes; j++) {
-            if (ld_processes.start_time[k] > ld_processes.start_time[j]) {
-                // 1. Swap Start Time
-                unsigned long temp_time = ld_processes.start_time[k];
-                ld_processes.start_time[k] = ld_processes.start_time[j];
-                ld_processes.start_time[j] = temp_time;
-                // 2. Swap Path (Con trỏ chuỗi)
-                char * temp_path = ld_processes.path[k];
-                ld_processes.path[k] = ld_processes.path[j];
-                ld_processes.path[j] = temp_path;
-#ifdef MLQ_SCHED
-                // 3. Swap Priority (Nếu dùng chế độ MLQ)
-                unsigned long temp_prio = ld_processes.prio[k];
-                ld_processes.prio[k] = ld_processes.prio[j];
-                ld_processes.prio[j] = temp_prio;
-#endif
-            }
-        }
-    }
-	//
-
-
-
+	if (i < num_processes) {
+		printf("Configure file lists only %d of %d processes\n", i, num_processes);
+		num_processes = i;
+	}
+	fclose(file);
 }
 
 int main(int argc, char * argv[]) {
@@ -242,11 +427,11 @@ int main(int argc, char * argv[]) {
 		printf("Usage: os [path to configure file]\n");
 		return 1;
 	}
-	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
+	char * path = malloc(strlen("input/") + strlen(argv[1]) + 1);
+	strcpy(path, "input/");
 	strcat(path, argv[1]);
 	read_config(path);
+	free(path);
 
 	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args =
@@ -260,13 +445,24 @@ int main(int argc, char * argv[]) {
 		args[i].id = i;
 	}
 	struct timer_id_t * ld_event = attach_event();
+#if defined(MM_PAGING) && defined(MM_KSM)
+	struct timer_id_t * ksmd_event = attach_event();
+#endif
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+	struct timer_id_t * kswapd_event = attach_event();
+#endif
+#if defined(MM_PAGING) && defined(MM_WRITEBACK)
+	struct timer_id_t * wbd_event = attach_event();
+#endif
 	start_timer();
 
 #ifdef MM_PAGING
     /* 1. Khởi tạo RAM */
     int rdmflag = 1;
     struct memphy_struct *mram = malloc(sizeof(struct memphy_struct));
-    init_memphy(mram, memramsz, rdmflag);
+    if ((nr_rambank > 0 ? init_memphy_banks(mram, rambank, nr_rambank, rdmflag)
+                        : init_memphy(mram, memramsz, rdmflag)) != 0)
+        exit(1);
     
     /* 2. Khởi tạo mảng các thiết bị SWAP */
     struct memphy_struct **mswp = malloc(PAGING_MAX_MMSWP * sizeof(struct memphy_struct *));
@@ -275,7 +471,18 @@ int main(int argc, char * argv[]) {
     for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
         if (memswpsz[sit] > 0) {
             mswp[sit] = malloc(sizeof(struct memphy_struct));
-            init_memphy(mswp[sit], memswpsz[sit], rdmflag);
+#ifdef MM_SWAP_SEQ
+            int swprdmflag = 0;
+#else
+            int swprdmflag = rdmflag;
+#endif
+            if (memswpfile[sit] != NULL) {
+                if (init_memphy_file(mswp[sit], memswpsz[sit], swprdmflag, memswpfile[sit]) != 0)
+                    exit(1);
+                printf("SWAP %d: %lu bytes in %s\n", sit, memswpsz[sit], memswpfile[sit]);
+            } else if (init_memphy(mswp[sit], memswpsz[sit], swprdmflag) != 0) {
+                exit(1);
+            }
         } else {
             mswp[sit] = NULL;
         }
@@ -298,6 +505,25 @@ int main(int argc, char * argv[]) {
     os.mswp = mswp;
     os.active_mswp_id = 0;
     os.tlb = tlb;  /* <--- ADD TLB TO KERNEL */
+#ifdef MM_ZSWAP
+    os.zswp = zswap_init(MM_ZSWAP_POOLSZ);
+#else
+    os.zswp = NULL;
+#endif
+#ifdef MM_KSM
+    os.ksm = ksm_init(mram);
+#else
+    os.ksm = NULL;
+#endif
+    /* Every read of an untouched page maps this frame, nothing wrote
+     * RAM yet so it reads zero */
+    os.zero_fpn = -1;
+#ifdef MM_DEMAND_ZERO
+    if (MEMPHY_get_freefp(mram, &os.zero_fpn) == 0)
+        MEMPHY_set_fdesc(mram, os.zero_fpn, NULL, 0, FRAME_ZERO);
+    else
+        os.zero_fpn = -1;
+#endif
     
     // Truyền tham số cho loader thread
     mm_ld_args->timer_id = ld_event;
@@ -319,12 +545,36 @@ int main(int argc, char * argv[]) {
 		pthread_create(&cpu[i], NULL,
 			cpu_routine, (void*)&args[i]);
 	}
+#if defined(MM_PAGING) && defined(MM_KSM)
+	pthread_t ksmd;
+	pthread_create(&ksmd, NULL, ksmd_routine, (void*)ksmd_event);
+#endif
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+	pthread_t kswapd;
+	pthread_create(&kswapd, NULL, kswapd_routine, (void*)kswapd_event);
+#endif
+#if defined(MM_PAGING) && defined(MM_WRITEBACK)
+	pthread_t wbd;
+	pthread_create(&wbd, NULL, wbd_routine, (void*)wbd_event);
+#endif
 
 	/* Wait for CPU and loader finishing */
 	for (i = 0; i < num_cpus; i++) {
 		pthread_join(cpu[i], NULL);
 	}
 	pthread_join(ld, NULL);
+#if defined(MM_PAGING) && defined(MM_KSM)
+	__atomic_store_n(&ksmd_stop, 1, __ATOMIC_RELEASE);
+	pthread_join(ksmd, NULL);
+#endif
+#if defined(MM_PAGING) && defined(MM_KSWAPD)
+	__atomic_store_n(&kswapd_stop, 1, __ATOMIC_RELEASE);
+	pthread_join(kswapd, NULL);
+#endif
+#if defined(MM_PAGING) && defined(MM_WRITEBACK)
+	__atomic_store_n(&wbd_stop, 1, __ATOMIC_RELEASE);
+	pthread_join(wbd, NULL);
+#endif
 
 #ifdef MM_PAGING
     /* Print TLB statistics before cleanup */
@@ -341,12 +591,79 @@ int main(int argc, char * argv[]) {
         tlb_dump(os.tlb);
         tlb_free(os.tlb);
     }
+#ifdef MM64
+    pgtbl_print_stats();
+    swap_print_stats();
+    swap_ra_print_stats();
+    swap_cache_print_stats();
+    reclaim_print_stats();
+#ifdef MM_WRITEBACK
+    writeback_print_stats();
+#endif
+    if (os.zswp)
+        zswap_print_stats(os.zswp);
+    if (os.ksm)
+        ksm_print_stats(os.ksm);
+#ifdef MM_DEMAND_ZERO
+    dzero_print_stats();
+#endif
+    if (os.zero_fpn != (addr_t)-1)
+        MEMPHY_put_freefp(os.mram, os.zero_fpn);
+
+    /* Every finished process gave its frames back, what is left in use
+     * belongs to nobody and would grow with the number of processes */
+    struct rusage ru;
+    int nr_clock = os.mm->nr_pgn;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("===== MEMORY AT EXIT =====\n");
+    printf("RAM free frames: %d/%lu\n", MEMPHY_nr_freefp(os.mram),
+           os.mram->maxsz / PAGING64_PAGESZ);
+    if (os.mram->mag && os.mram->nr_node == 0)
+        printf("RAM magazines: %lu frames handed out, %lu refills, %lu drains, %lu flushes\n",
+               os.mram->mag_hit, os.mram->mag_refill, os.mram->mag_drain, os.mram->mag_flush);
+    for (int i = 0; i < os.mram->nr_node; i++) {
+        struct memphy_struct *n = &os.mram->node[i];
+        printf("RAM node %d: %lu KB, CPUs %d-%d, %lu/%lu frames used\n",
+               i, n->maxsz / 1024, n->cpu_first, n->cpu_last,
+               n->maxsz / PAGING64_PAGESZ - MEMPHY_nr_freefp(n), n->maxsz / PAGING64_PAGESZ);
+        printf("RAM node %d: %lu local, %lu remote accesses, %lu frames from fallback, modeled access %.3f ms\n",
+               i, n->nr_local, n->nr_remote, n->nr_fallback, n->numa_ns / 1e6);
+        if (n->mag)
+            printf("RAM node %d magazines: %lu frames handed out, %lu refills, %lu drains, %lu flushes\n",
+                   i, n->mag_hit, n->mag_refill, n->mag_drain, n->mag_flush);
+    }
+    for (int i = 0; i < PAGING_MAX_MMSWP; i++) {
+        if (os.mswp[i] == NULL)
+            continue;
+        printf("SWAP %d free frames: %d/%lu\n", i, MEMPHY_nr_freefp(os.mswp[i]),
+               os.mswp[i]->maxsz / PAGING64_PAGESZ);
+        if (os.mswp[i]->mag)
+            printf("SWAP %d magazines: %lu frames handed out, %lu refills, %lu drains, %lu flushes\n",
+                   i, os.mswp[i]->mag_hit, os.mswp[i]->mag_refill,
+                   os.mswp[i]->mag_drain, os.mswp[i]->mag_flush);
+        if (!os.mswp[i]->rdmflg)
+            printf("SWAP %d seeks: %lu, %lu KB travelled, modeled latency %.3f ms\n",
+                   i, os.mswp[i]->nr_seeks, os.mswp[i]->seek_bytes / 1024,
+                   os.mswp[i]->seek_ns / 1e6);
+    }
+    printf("CLOCK list: %d pages\n", nr_clock);
+    printf("Host peak RSS: %ld KB\n", ru.ru_maxrss);
+    printf("==========================\n");
+#endif
     
+    free_memphy(os.mram);
     free(os.mram);
     for(int i = 0; i < PAGING_MAX_MMSWP; i++) {
-        if (os.mswp[i] != NULL) free(os.mswp[i]);
+        if (os.mswp[i] != NULL) {
+            free_memphy(os.mswp[i]);
+            free(os.mswp[i]);
+        }
+        free(memswpfile[i]);
     }
     free(os.mswp);
+    zswap_free(os.zswp);
+    ksm_free(os.ksm);
+    free_mm(os.mm);
     free(mm_ld_args);
 #endif
 
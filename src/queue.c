@@ -9,13 +9,35 @@ int empty(struct queue_t *q)
         return (q->size == 0);
 }
 
+/* Double the ring buffer and unwrap it so that head is 0 again */
+static int queue_grow(struct queue_t *q)
+{
+        int newcap = (q->capacity > 0) ? q->capacity * 2 : QUEUE_INIT_SIZE;
+        struct pcb_t **newproc = malloc(sizeof(struct pcb_t *) * newcap);
+        if (newproc == NULL)
+                return -1;
+
+        for (int i = 0; i < q->size; i++) {
+                newproc[i] = q->proc[(q->head + i) % q->capacity];
+        }
+
+        free(q->proc);
+        q->proc = newproc;
+        q->head = 0;
+        q->capacity = newcap;
+        return 0;
+}
+
 void enqueue(struct queue_t *q, struct pcb_t *proc)
 {
         /* TODO: put a new process to queue [q] */
-        if (q->size < MAX_QUEUE_SIZE) {
-                q->proc[q->size] = proc;
-                q->size++;
+        if (q->size == q->capacity && queue_grow(q) != 0) {
+                printf("ERROR: enqueue cannot grow queue (size=%d)\n", q->size);
+                return;
         }
+
+        q->proc[(q->head + q->size) % q->capacity] = proc;
+        q->size++;
 }
 
 struct pcb_t *dequeue(struct queue_t *q)
@@ -26,38 +48,44 @@ struct pcb_t *dequeue(struct queue_t *q)
 
 	if (empty(q)) return NULL;
         
-        struct pcb_t *proc = q->proc[0];
-
-        for (int i = 0; i < q->size - 1; i++) {
-                q->proc[i] = q->proc[i+1];
-        }
+        struct pcb_t *proc = q->proc[q->head];
 
+        q->proc[q->head] = NULL;
+        q->head = (q->head + 1) % q->capacity;
         q->size--;
-        q->proc[q->size] = NULL;
         
         return proc;
 }
 
+struct pcb_t *queue_at(struct queue_t *q, int idx)
+{
+        if (q == NULL || idx < 0 || idx >= q->size)
+                return NULL;
+
+        return q->proc[(q->head + idx) % q->capacity];
+}
+
 struct pcb_t *purgequeue(struct queue_t *q, struct pcb_t *proc)
 {
         /* TODO: remove a specific item from queue
          * */
         int found_index = -1;
         for (int i = 0; i < q->size; i++) {
-                if (q->proc[i] == proc) {
+                if (queue_at(q, i) == proc) {
                         found_index = i;
                         break;
                 }
         }
         
         if (found_index != -1) {
-                struct pcb_t *removed_proc = q->proc[found_index];
+                /* Close the gap by shifting the tail one slot towards head */
                 for (int i = found_index; i < q->size - 1; i++) {
-                        q->proc[i] = q->proc[i+1];
+                        q->proc[(q->head + i) % q->capacity] =
+                                q->proc[(q->head + i + 1) % q->capacity];
                 }
                 q->size--;
-                q->proc[q->size] = NULL;
-                return removed_proc;
+                q->proc[(q->head + q->size) % q->capacity] = NULL;
+                return proc;
         }
         return NULL;
-}
\ No newline at end of file
+}
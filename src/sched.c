@@ -23,11 +23,9 @@ static pthread_mutex_t queue_lock;
 
 static struct queue_t running_list;
 
-#define MAX_PID_TRACKING 1000 //Thêm define
 #ifdef MLQ_SCHED
 static struct queue_t mlq_ready_queue[MAX_PRIO];
 static int slot[MAX_PRIO];
-static uint64_t proc_start_time[MAX_PID_TRACKING]; //Thêm cả cái này
 #endif
 
 int queue_empty(void) {
@@ -48,11 +46,6 @@ void init_scheduler(void) {
 		mlq_ready_queue[i].size = 0;
 		slot[i] = MAX_PRIO - i; 
 	}
-	// Thêm luôn vòng for
-    for (i = 0; i < MAX_PID_TRACKING; i++) {
-        proc_start_time[i] = 0;
-    }
-
 #endif
 	ready_queue.size = 0;
 	run_queue.size = 0;
@@ -110,9 +103,7 @@ struct pcb_t * get_mlq_proc(void) {
 	if (proc != NULL) {
 		enqueue(&running_list, proc);
 		// Thêm if cho thời gian bắt đầu
-        if (proc->pid < MAX_PID_TRACKING) {
-            proc_start_time[proc->pid] = current_time();
-        }
+		proc->dispatch_time = current_time();
 
 	}
 
@@ -135,22 +126,16 @@ void put_mlq_proc(struct pcb_t * proc) {
 	 */
 
 	pthread_mutex_lock(&queue_lock);
+	purgequeue(&running_list, proc);
 	enqueue(&mlq_ready_queue[proc->prio], proc);
 
 	// Thêm cái này
-    if (proc->pid < MAX_PID_TRACKING) {
-        uint64_t end_time = current_time();
-        uint64_t start = proc_start_time[proc->pid];
-
-        if (end_time >= start) {
-            int diff = (int)(end_time - start);
-            slot[proc->prio] -= diff;
-        } else {
-            slot[proc->prio]--;
-        }
-    } else {
-        slot[proc->prio]--;
-    }
+	uint64_t end_time = current_time();
+	if (end_time >= proc->dispatch_time) {
+		slot[proc->prio] -= (int)(end_time - proc->dispatch_time);
+	} else {
+		slot[proc->prio]--;
+	}
 
 
 	pthread_mutex_unlock(&queue_lock);
@@ -287,6 +272,7 @@ void put_proc(struct pcb_t * proc) {
 	 */
 
 	pthread_mutex_lock(&queue_lock);
+	purgequeue(&running_list, proc);
 	enqueue(&run_queue, proc);
 	pthread_mutex_unlock(&queue_lock);
 }
@@ -304,4 +290,12 @@ void add_proc(struct pcb_t * proc) {
 	enqueue(&ready_queue, proc);
 	pthread_mutex_unlock(&queue_lock);	
 }
-#endif
\ No newline at end of file
+#endif
+
+void finish_proc(struct pcb_t * proc) {
+	/* The process will never be dispatched again, so it must
+	 * not be visible to the syscall lookups on running_list */
+	pthread_mutex_lock(&queue_lock);
+	purgequeue(&running_list, proc);
+	pthread_mutex_unlock(&queue_lock);
+}
@@ -13,9 +13,14 @@ int __sys_dump(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs) {
 
     if (krnl->mram == NULL) {
         printf("Error: Physical memory (MRAM) is not initialized.\n");
+        pthread_mutex_unlock(&dump_lock);
         return -1;
     }
-    MEMPHY_dump(krnl->mram);
+    /* a1: first frame, a2: number of frames, 0 for the whole memory */
+    if (regs->a2 == 0)
+        MEMPHY_dump(krnl->mram);
+    else if (MEMPHY_dump_range(krnl->mram, regs->a1, regs->a2) != 0)
+        printf("Error: frames %lu+%lu are out of the memory.\n", regs->a1, regs->a2);
     pthread_mutex_unlock(&dump_lock);
 
     return 0;
@@ -0,0 +1,55 @@
+/* src/sys_frame.c */
+#include "common.h"
+#include "syscall.h"
+#include "mm.h"
+#include <stdio.h>
+#include <pthread.h>
+
+static pthread_mutex_t sys_frame_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *frame_state_name[FRAME_NR_STATE] = {
+    "free", "anon", "huge", "ksm", "zero", "swap", "swapcache"
+};
+
+/* Một dòng histogram cho mỗi thiết bị nhớ */
+static void print_frame_hist(const char *name, struct memphy_struct *mp)
+{
+    unsigned long hist[FRAME_NR_STATE], nr_swpcache, nr_map[2];
+    int untracked = MEMPHY_frame_hist(mp, hist, &nr_swpcache, nr_map);
+    int st;
+
+    if (untracked < 0) {
+        printf("%s: no frame descriptors\n", name);
+        return;
+    }
+    printf("%s:", name);
+    for (st = 0; st < FRAME_NR_STATE; st++)
+        if (hist[st] != 0 || st == FRAME_FREE)
+            printf(" %s=%lu", frame_state_name[st], hist[st]);
+    printf(" untracked=%d\n", untracked);
+    if (nr_swpcache + nr_map[0] + nr_map[1] != 0)
+        printf("%s: %lu frames in swap cache, %lu pages on KSM frames, %lu on the zero frame\n",
+               name, nr_swpcache, nr_map[0], nr_map[1]);
+}
+
+int __sys_frame_stat(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs) {
+    char name[16];
+    int i;
+
+    pthread_mutex_lock(&sys_frame_lock);
+    printf("--- [SYSCALL FRAME STAT] Request from PID: %d ---\n", pid);
+
+#ifdef MM_PAGING
+    print_frame_hist("RAM", krnl->mram);
+    for (i = 0; i < PAGING_MAX_MMSWP; i++) {
+        if (krnl->mswp[i] == NULL)
+            continue;
+        snprintf(name, sizeof(name), "SWAP %d", i);
+        print_frame_hist(name, krnl->mswp[i]);
+    }
+#else
+    printf("Error: MM_PAGING is not defined. Frame descriptors not supported.\n");
+#endif
+    pthread_mutex_unlock(&sys_frame_lock);
+    return 0;
+}
@@ -40,7 +40,7 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
 
    q = krnl->running_list;
    for (int i=0; i<q->size; ++i){
-        struct pcb_t *proc = q->proc[i];
+        struct pcb_t *proc = queue_at(q, i);
         if (proc->pid == pid){
             caller = proc;
             break;
@@ -92,7 +92,7 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
             printf("----------------------------------------------------\n");
             printf("PhyAddres from SYSCALL WRITE: %lu \n",regs->a2);
             printf("Value from SYSCALL WRITE: %ld \n",regs->a3);
-            MEMPHY_dump(krnl->mram);
+            MEMPHY_dump_range(krnl->mram, regs->a2 / PAGING64_PAGESZ, 1);
             break;
    default:
             printf("Memop code: %d\n", memop);
@@ -15,7 +15,7 @@ int __sys_print_pgtbl(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs) {
     struct queue_t *q = krnl->running_list;
 
     for (int i = 0; i < q->size; ++i) {
-        struct pcb_t *proc = q->proc[i];
+        struct pcb_t *proc = queue_at(q, i);
         if (proc->pid == pid) {
             caller = proc;
             break;
@@ -11,7 +11,7 @@ int __sys_print_regs(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs) {
     struct pcb_t *caller = NULL;
     struct queue_t *q = krnl->running_list;
     for (int i = 0; i < q->size; ++i) {
-        struct pcb_t *proc = q->proc[i];
+        struct pcb_t *proc = queue_at(q, i);
         if (proc->pid == pid) {
             caller = proc;
             break;
@@ -6,6 +6,7 @@
 #include "common.h"
 #include "os-mm.h"
 #include "mm.h"
+#include "mm64.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,6 +29,8 @@ struct tlb_t* tlb_init() {
     tlb->misses = 0;
     tlb->size = TLB_SIZE;
     tlb->access_counter = 0;
+    memset(tlb->huge, 0, sizeof(tlb->huge));
+    tlb->huge_hits = 0;
     
     return tlb;
 }
@@ -47,6 +50,20 @@ static struct tlb_entry_t* tlb_find_entry(struct tlb_t* tlb, addr_t vpn, uint32_
     return NULL;
 }
 
+/* Find the 2MB entry covering vpn */
+static struct tlb_entry_t* tlb_find_huge(struct tlb_t* tlb, addr_t vpn, uint32_t pid) {
+    addr_t hvpn = PAGING64_HUGE_PGN(vpn);
+    
+    for (int i = 0; i < TLB_HUGE_SIZE; i++) {
+        struct tlb_entry_t* entry = &tlb->huge[i];
+        if (entry->valid && entry->vpn == hvpn && entry->pid == pid) {
+            return entry;
+        }
+    }
+    
+    return NULL;
+}
+
 /* Find LRU victim in a hash chain */
 static struct tlb_entry_t** tlb_find_lru_victim(struct tlb_t* tlb, int index) {
     struct tlb_entry_t** victim = &tlb->entries[index];
@@ -139,6 +156,42 @@ int tlb_insert(struct tlb_t* tlb, addr_t vpn, int fpn, uint32_t pid,
     return 0;
 }
 
+/*
+ * tlb_insert_huge - cache the 2MB page holding vpn, fpn is the frame
+ * of vpn itself, the entry keeps the first frame of the huge page
+ */
+int tlb_insert_huge(struct tlb_t* tlb, addr_t vpn, int fpn, uint32_t pid,
+                    uint8_t dirty, uint8_t referenced) {
+    pthread_mutex_lock(&tlb_lock);
+    
+    struct tlb_entry_t* entry = tlb_find_huge(tlb, vpn, pid);
+    
+    if (entry == NULL) {
+        /* Invalid slot first, otherwise LRU */
+        entry = &tlb->huge[0];
+        for (int i = 0; i < TLB_HUGE_SIZE; i++) {
+            if (!tlb->huge[i].valid) {
+                entry = &tlb->huge[i];
+                break;
+            }
+            if (tlb->huge[i].last_used < entry->last_used)
+                entry = &tlb->huge[i];
+        }
+    }
+    
+    entry->vpn = PAGING64_HUGE_PGN(vpn);
+    entry->fpn = fpn - (int)(vpn & (PAGING64_HUGE_NRPAGES - 1));
+    entry->pid = pid;
+    entry->valid = TLB_ENTRY_VALID;
+    entry->dirty = dirty;
+    entry->referenced = referenced;
+    entry->last_used = ++tlb->access_counter;
+    entry->next = NULL;
+    
+    pthread_mutex_unlock(&tlb_lock);
+    return 0;
+}
+
 /* Lookup TLB - returns 1 if hit, 0 if miss */
 int tlb_lookup(struct tlb_t* tlb, addr_t vpn, uint32_t pid, int* fpn) {
     pthread_mutex_lock(&tlb_lock);
@@ -155,6 +208,18 @@ int tlb_lookup(struct tlb_t* tlb, addr_t vpn, uint32_t pid, int* fpn) {
         return 1; /* Hit */
     }
     
+    /* One 2MB entry covers 512 pages */
+    entry = tlb_find_huge(tlb, vpn, pid);
+    if (entry != NULL) {
+        *fpn = entry->fpn + (int)(vpn & (PAGING64_HUGE_NRPAGES - 1));
+        entry->last_used = ++tlb->access_counter;
+        tlb->hits++;
+        tlb->huge_hits++;
+        
+        pthread_mutex_unlock(&tlb_lock);
+        return 1; /* Hit */
+    }
+    
     /* TLB miss */
     tlb->misses++;
     pthread_mutex_unlock(&tlb_lock);
@@ -177,6 +242,13 @@ int tlb_invalidate_entry(struct tlb_t* tlb, addr_t vpn, uint32_t pid) {
         entry = entry->next;
     }
     
+    entry = tlb_find_huge(tlb, vpn, pid);
+    if (entry != NULL) {
+        entry->valid = TLB_ENTRY_INVALID;
+        pthread_mutex_unlock(&tlb_lock);
+        return 0;
+    }
+    
     pthread_mutex_unlock(&tlb_lock);
     return -1; /* Entry not found */
 }
@@ -195,6 +267,12 @@ int tlb_invalidate_process(struct tlb_t* tlb, uint32_t pid) {
         }
     }
     
+    for (int i = 0; i < TLB_HUGE_SIZE; i++) {
+        if (tlb->huge[i].valid && tlb->huge[i].pid == pid) {
+            tlb->huge[i].valid = TLB_ENTRY_INVALID;
+        }
+    }
+    
     pthread_mutex_unlock(&tlb_lock);
     return 0;
 }
@@ -203,18 +281,25 @@ int tlb_set_dirty(struct tlb_t* tlb, struct pcb_t* caller, addr_t vpn) {
     pthread_mutex_lock(&tlb_lock);
     
     struct tlb_entry_t* entry = tlb_find_entry(tlb, vpn, caller->pid);
-    if (entry != NULL && entry->valid) {
+    if (entry == NULL)
+        entry = tlb_find_huge(tlb, vpn, caller->pid);
+    int found = (entry != NULL && entry->valid);
+    if (found) {
         entry->dirty = 1;
-        
+    }
+    
+    /* The page table lock comes before tlb_lock, drop it first */
+    pthread_mutex_unlock(&tlb_lock);
+    
+    if (found) {
         // Update PTE dirty bit
-        uint32_t pte = pte_get_entry(caller, vpn);
-        if (pte != (uint32_t)-1) {
+        addr_t pte = pte_get_entry(caller, vpn);
+        if (PAGING_PAGE_PRESENT(pte)) {
             SETBIT(pte, PAGING_PTE_DIRTY_MASK);
             pte_set_entry(caller, vpn, pte);
         }
     }
     
-    pthread_mutex_unlock(&tlb_lock);
     return (entry != NULL) ? 0 : -1;
 }
 
@@ -223,6 +308,8 @@ int tlb_set_referenced(struct tlb_t* tlb, addr_t vpn, uint32_t pid) {
     pthread_mutex_lock(&tlb_lock);
     
     struct tlb_entry_t* entry = tlb_find_entry(tlb, vpn, pid);
+    if (entry == NULL)
+        entry = tlb_find_huge(tlb, vpn, pid);
     if (entry != NULL && entry->valid) {
         entry->referenced = 1;
     }
@@ -255,6 +342,7 @@ void tlb_dump(struct tlb_t* tlb) {
     printf("===== TLB DUMP =====\n");
     printf("Size: %d entries\n", TLB_SIZE);
     printf("Hits: %d, Misses: %d\n", tlb->hits, tlb->misses);
+    printf("2MB entries: %d, hits %d\n", TLB_HUGE_SIZE, tlb->huge_hits);
     
     if (tlb->hits + tlb->misses > 0) {
         printf("Hit Rate: %.2f%%\n", 
@@ -275,6 +363,15 @@ void tlb_dump(struct tlb_t* tlb) {
             entry = entry->next;
         }
     }
+    for (int i = 0; i < TLB_HUGE_SIZE; i++) {
+        struct tlb_entry_t* entry = &tlb->huge[i];
+        if (entry->valid) {
+            printf("  [2MB] VPN: %lu.. -> FPN: %u.. (PID: %d, Age: %lu)\n",
+                   entry->vpn << PAGING64_LEVEL_BITS, entry->fpn, entry->pid,
+                   tlb->access_counter - entry->last_used);
+            valid_count++;
+        }
+    }
     printf("Valid entries: %d\n", valid_count);
     printf("====================\n");
     